@@ -16,7 +16,11 @@ examples/bigxml-xsd
 
 QUICK_TESTS =\
 examples/c14n-default-attr\
+examples/c14n-digest\
+examples/c14n-jobs\
 examples/c14n-newlines\
+examples/c14n-stream\
+examples/c14n-xpath\
 examples/c14n1\
 examples/c14n2\
 examples/command-help\
@@ -25,6 +29,7 @@ examples/countnode1\
 examples/delete1\
 examples/depyx-bug120a\
 examples/depyx-bug120b\
+examples/depyx-long-line\
 examples/dtd1\
 examples/dtd2\
 examples/dtd3\
@@ -44,15 +49,24 @@ examples/ed-subnode\
 examples/elem1\
 examples/elem2\
 examples/elem3\
+examples/elem-count\
 examples/elem-depth\
+examples/elem-files\
 examples/elem-uniq\
 examples/escape1\
 examples/exslt-ed\
 examples/exslt1\
 examples/external-entity\
 examples/findfile1\
+examples/fo-inplace\
+examples/fo-jobs\
+examples/fo-minify\
+examples/fo-stream\
 examples/genxml1\
 examples/hello1\
+examples/infer-dtd\
+examples/infer-rng\
+examples/infer-xsd\
 examples/localname1\
 examples/look1\
 examples/move1\
@@ -60,7 +74,9 @@ examples/N-order\
 examples/noindent1\
 examples/ns1\
 examples/pyx\
+examples/pyx-no-sort\
 examples/pyx-ns\
+examples/pyx-stdin\
 examples/recover1\
 examples/rename-attr1\
 examples/rename-elem1\
@@ -87,8 +103,21 @@ examples/unicode1\
 examples/update-attr1\
 examples/update-elem1\
 examples/valid1\
+examples/valid-dtd-content\
+examples/valid-dtd-ids\
+examples/valid-dtd-ns\
+examples/valid-files-from\
+examples/valid-jobs\
+examples/xinclude-cache\
 examples/xinclude1\
+examples/xsl-files-from\
+examples/xsl-jobs\
+examples/xsl-output-dir\
 examples/xsl-param1\
+examples/xsl-params-file\
+examples/xsl-profile\
+examples/xsl-stream-split\
+examples/xsl-stream-split-dir\
 examples/xsl-sum1
 
 # default to all the tests
@@ -99,7 +128,6 @@ qcheck :
 	@$(MAKE) TESTS="$(QUICK_TESTS)" check
 
 XFAIL_TESTS =\
-examples/bigxml-dtd\
 examples/ed-namespace
 
 if !HAVE_EXSLT_XPATH_REGISTER
@@ -0,0 +1,262 @@
+/*
+
+XMLStarlet: Command Line Toolkit to query/edit/check/transform XML documents
+
+Copyright (c) 2002-2004 Mikhail Grushinskiy.  All Rights Reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+#include <config.h>
+
+#include <string.h>
+
+#include "digest.h"
+
+/* keep digestWord arithmetic to 32 bits where it is wider */
+#define TRUNC32(x) ((x) & 0xffffffffUL)
+#define ROTL(x, n) TRUNC32(((x) << (n)) | (TRUNC32(x) >> (32 - (n))))
+#define ROTR(x, n) TRUNC32((TRUNC32(x) >> (n)) | ((x) << (32 - (n))))
+
+#define LOAD32(p) (((digestWord) (p)[0] << 24) | ((digestWord) (p)[1] << 16) | \
+                   ((digestWord) (p)[2] << 8) | (digestWord) (p)[3])
+
+static const digestWord sha256K[64] = {
+    0x428a2f98UL, 0x71374491UL, 0xb5c0fbcfUL, 0xe9b5dba5UL,
+    0x3956c25bUL, 0x59f111f1UL, 0x923f82a4UL, 0xab1c5ed5UL,
+    0xd807aa98UL, 0x12835b01UL, 0x243185beUL, 0x550c7dc3UL,
+    0x72be5d74UL, 0x80deb1feUL, 0x9bdc06a7UL, 0xc19bf174UL,
+    0xe49b69c1UL, 0xefbe4786UL, 0x0fc19dc6UL, 0x240ca1ccUL,
+    0x2de92c6fUL, 0x4a7484aaUL, 0x5cb0a9dcUL, 0x76f988daUL,
+    0x983e5152UL, 0xa831c66dUL, 0xb00327c8UL, 0xbf597fc7UL,
+    0xc6e00bf3UL, 0xd5a79147UL, 0x06ca6351UL, 0x14292967UL,
+    0x27b70a85UL, 0x2e1b2138UL, 0x4d2c6dfcUL, 0x53380d13UL,
+    0x650a7354UL, 0x766a0abbUL, 0x81c2c92eUL, 0x92722c85UL,
+    0xa2bfe8a1UL, 0xa81a664bUL, 0xc24b8b70UL, 0xc76c51a3UL,
+    0xd192e819UL, 0xd6990624UL, 0xf40e3585UL, 0x106aa070UL,
+    0x19a4c116UL, 0x1e376c08UL, 0x2748774cUL, 0x34b0bcb5UL,
+    0x391c0cb3UL, 0x4ed8aa4aUL, 0x5b9cca4fUL, 0x682e6ff3UL,
+    0x748f82eeUL, 0x78a5636fUL, 0x84c87814UL, 0x8cc70208UL,
+    0x90befffaUL, 0xa4506cebUL, 0xbef9a3f7UL, 0xc67178f2UL
+};
+
+/**
+ *  FIPS 180-4 SHA-256 compression of one 64 byte @block
+ */
+static void
+sha256Block(digestWord *state, const unsigned char *block)
+{
+    digestWord w[64], a, b, c, d, e, f, g, h, t1, t2;
+    int i;
+
+    for (i = 0; i < 16; i++)
+        w[i] = LOAD32(block + 4 * i);
+    for (; i < 64; i++)
+    {
+        digestWord s0 = ROTR(w[i-15], 7) ^ ROTR(w[i-15], 18) ^ (w[i-15] >> 3);
+        digestWord s1 = ROTR(w[i-2], 17) ^ ROTR(w[i-2], 19) ^ (w[i-2] >> 10);
+        w[i] = TRUNC32(w[i-16] + s0 + w[i-7] + s1);
+    }
+
+    a = state[0]; b = state[1]; c = state[2]; d = state[3];
+    e = state[4]; f = state[5]; g = state[6]; h = state[7];
+    for (i = 0; i < 64; i++)
+    {
+        t1 = h + (ROTR(e, 6) ^ ROTR(e, 11) ^ ROTR(e, 25)) +
+            ((e & f) ^ (~e & g)) + sha256K[i] + w[i];
+        t2 = (ROTR(a, 2) ^ ROTR(a, 13) ^ ROTR(a, 22)) +
+            ((a & b) ^ (a & c) ^ (b & c));
+        h = g; g = f; f = e;
+        e = TRUNC32(d + t1);
+        d = c; c = b; b = a;
+        a = TRUNC32(t1 + t2);
+    }
+    state[0] = TRUNC32(state[0] + a); state[1] = TRUNC32(state[1] + b);
+    state[2] = TRUNC32(state[2] + c); state[3] = TRUNC32(state[3] + d);
+    state[4] = TRUNC32(state[4] + e); state[5] = TRUNC32(state[5] + f);
+    state[6] = TRUNC32(state[6] + g); state[7] = TRUNC32(state[7] + h);
+}
+
+/**
+ *  FIPS 180-4 SHA-1 compression of one 64 byte @block
+ */
+static void
+sha1Block(digestWord *state, const unsigned char *block)
+{
+    digestWord w[80], a, b, c, d, e, t;
+    int i;
+
+    for (i = 0; i < 16; i++)
+        w[i] = LOAD32(block + 4 * i);
+    for (; i < 80; i++)
+        w[i] = ROTL(w[i-3] ^ w[i-8] ^ w[i-14] ^ w[i-16], 1);
+
+    a = state[0]; b = state[1]; c = state[2]; d = state[3]; e = state[4];
+    for (i = 0; i < 80; i++)
+    {
+        if (i < 20)
+            t = ((b & c) | (~b & d)) + 0x5a827999UL;
+        else if (i < 40)
+            t = (b ^ c ^ d) + 0x6ed9eba1UL;
+        else if (i < 60)
+            t = ((b & c) | (b & d) | (c & d)) + 0x8f1bbcdcUL;
+        else
+            t = (b ^ c ^ d) + 0xca62c1d6UL;
+        t = TRUNC32(t + ROTL(a, 5) + e + w[i]);
+        e = d; d = c; c = ROTL(b, 30); b = a; a = t;
+    }
+    state[0] = TRUNC32(state[0] + a); state[1] = TRUNC32(state[1] + b);
+    state[2] = TRUNC32(state[2] + c); state[3] = TRUNC32(state[3] + d);
+    state[4] = TRUNC32(state[4] + e);
+}
+
+static void
+digestBlock(digestContext *ctx, const unsigned char *block)
+{
+    if (ctx->algorithm == DIGEST_SHA1)
+        sha1Block(ctx->state, block);
+    else
+        sha256Block(ctx->state, block);
+}
+
+/**
+ *  Get the algorithm called @name ("sha256" or "sha1"), returns -1 for
+ *  an unknown one
+ */
+int
+digestAlgorithmByName(const char *name)
+{
+    if (strcmp(name, "sha256") == 0 || strcmp(name, "sha-256") == 0)
+        return DIGEST_SHA256;
+    if (strcmp(name, "sha1") == 0 || strcmp(name, "sha-1") == 0)
+        return DIGEST_SHA1;
+    return -1;
+}
+
+void
+digestInit(digestContext *ctx, digestAlgorithm algorithm)
+{
+    static const digestWord sha1Init[5] = {
+        0x67452301UL, 0xefcdab89UL, 0x98badcfeUL, 0x10325476UL, 0xc3d2e1f0UL
+    };
+    static const digestWord sha256Init[8] = {
+        0x6a09e667UL, 0xbb67ae85UL, 0x3c6ef372UL, 0xa54ff53aUL,
+        0x510e527fUL, 0x9b05688cUL, 0x1f83d9abUL, 0x5be0cd19UL
+    };
+
+    memset(ctx, 0, sizeof(*ctx));
+    ctx->algorithm = algorithm;
+    if (algorithm == DIGEST_SHA1)
+        memcpy(ctx->state, sha1Init, sizeof(sha1Init));
+    else
+        memcpy(ctx->state, sha256Init, sizeof(sha256Init));
+}
+
+void
+digestUpdate(digestContext *ctx, const void *data, size_t len)
+{
+    const unsigned char *p = data;
+    size_t used = ctx->count_lo & 63;
+
+    ctx->count_lo = TRUNC32(ctx->count_lo + len);
+    if (ctx->count_lo < (len & 0xffffffffUL))
+        ctx->count_hi++;
+    ctx->count_hi = TRUNC32(ctx->count_hi + ((len >> 16) >> 16));
+
+    if (used > 0)
+    {
+        size_t fill = 64 - used;
+        if (len < fill)
+        {
+            memcpy(ctx->block + used, p, len);
+            return;
+        }
+        memcpy(ctx->block + used, p, fill);
+        digestBlock(ctx, ctx->block);
+        p += fill;
+        len -= fill;
+    }
+    for (; len >= 64; p += 64, len -= 64)
+        digestBlock(ctx, p);
+    memcpy(ctx->block, p, len);
+}
+
+/**
+ *  Finish the digest and store it in @digest (DIGEST_MAX_SIZE bytes
+ *  are enough), returns its size in bytes
+ */
+int
+digestFinal(digestContext *ctx, unsigned char *digest)
+{
+    static const unsigned char pad[64] = { 0x80 };
+    unsigned char length[8];
+    digestWord hi = TRUNC32((ctx->count_hi << 3) | (ctx->count_lo >> 29));
+    digestWord lo = TRUNC32(ctx->count_lo << 3);
+    size_t used = ctx->count_lo & 63;
+    int i, words;
+
+    for (i = 0; i < 4; i++)
+    {
+        length[i] = (unsigned char) (hi >> (24 - 8 * i));
+        length[i + 4] = (unsigned char) (lo >> (24 - 8 * i));
+    }
+    digestUpdate(ctx, pad, (used < 56)? 56 - used : 120 - used);
+    digestUpdate(ctx, length, 8);
+
+    words = (ctx->algorithm == DIGEST_SHA1)? 5 : 8;
+    for (i = 0; i < 4 * words; i++)
+        digest[i] = (unsigned char) (ctx->state[i / 4] >> (24 - 8 * (i % 4)));
+    return 4 * words;
+}
+
+/**
+ *  Write @digest of @size bytes as lower case hex digits into @hex,
+ *  which must have room for 2 * @size + 1 characters
+ */
+void
+digestHex(const unsigned char *digest, int size, char *hex)
+{
+    static const char digits[] = "0123456789abcdef";
+    int i;
+
+    for (i = 0; i < size; i++)
+    {
+        *hex++ = digits[digest[i] >> 4];
+        *hex++ = digits[digest[i] & 15];
+    }
+    *hex = '\0';
+}
+
+static int
+digestBufferWrite(void *context, const char *buffer, int len)
+{
+    digestUpdate(context, buffer, len);
+    return len;
+}
+
+/**
+ *  Create an output buffer hashing what is written to it into @ctx,
+ *  for the libxml2 functions that save through xmlOutputBuffer
+ */
+xmlOutputBufferPtr
+digestOutputBuffer(digestContext *ctx)
+{
+    return xmlOutputBufferCreateIO(digestBufferWrite, NULL, ctx, NULL);
+}
@@ -0,0 +1,74 @@
+#ifndef __DIGEST_H
+#define __DIGEST_H
+
+/*
+
+XMLStarlet: Command Line Toolkit to query/edit/check/transform XML documents
+
+Copyright (c) 2002-2004 Mikhail Grushinskiy.  All Rights Reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+#include <stddef.h>
+
+#include <libxml/xmlIO.h>
+
+#if HAVE_STDINT_H
+# include <stdint.h>
+typedef uint32_t digestWord;
+#else
+typedef unsigned long digestWord;      /* at least 32 bits */
+#endif
+
+/*
+ *  Message digests of output streams, e.g. to check signatures of
+ *  canonical XML without piping it through another program.
+ */
+
+typedef enum {
+    DIGEST_SHA1,
+    DIGEST_SHA256
+} digestAlgorithm;
+
+/* size of the largest digest in bytes */
+#define DIGEST_MAX_SIZE 32
+
+typedef struct _digestContext {
+    digestAlgorithm algorithm;
+    digestWord state[8];
+    digestWord count_lo;                /* bytes hashed so far */
+    digestWord count_hi;
+    unsigned char block[64];            /* the unprocessed input */
+} digestContext;
+
+int digestAlgorithmByName(const char *name);
+
+void digestInit(digestContext *ctx, digestAlgorithm algorithm);
+
+void digestUpdate(digestContext *ctx, const void *data, size_t len);
+
+int digestFinal(digestContext *ctx, unsigned char *digest);
+
+void digestHex(const unsigned char *digest, int size, char *hex);
+
+xmlOutputBufferPtr digestOutputBuffer(digestContext *ctx);
+
+#endif /* __DIGEST_H */
@@ -0,0 +1,324 @@
+/*
+
+XMLStarlet: Command Line Toolkit to query/edit/check/transform XML documents
+
+Copyright (c) 2002-2004 Mikhail Grushinskiy.  All Rights Reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libxml/xmlerror.h>
+#include <libxml/globals.h>
+#include <libxml/xmlmemory.h>
+#include <libxml/uri.h>
+
+#include "xmlstar.h"
+#include "jobs.h"
+
+#if HAVE_PTHREAD && defined(LIBXML_THREAD_ENABLED)
+# define XSTAR_THREADS 1
+# include <pthread.h>
+#else
+# define XSTAR_THREADS 0
+#endif
+
+/* how many items the workers may get ahead of the output */
+#define JOB_WINDOW_PER_THREAD 4
+
+/**
+ *  Parse the argument of a --jobs option, returns 0 if it is not
+ *  a positive number
+ */
+int
+parseJobCount(const char *str)
+{
+    int value;
+    char extra;
+
+    if (sscanf(str, "%d%c", &value, &extra) != 1 || value < 1)
+        return 0;
+    return value;
+}
+
+/**
+ *  Read the next non-empty line of a --files-from list into *@line
+ *  (of *@size bytes, grown as needed) without its line terminator;
+ *  returns 0 at the end of the list
+ */
+int
+readListLine(FILE *list, char **line, size_t *size)
+{
+    for (;;)
+    {
+        size_t len;
+
+        if (*line == NULL)
+        {
+            if (*size < 2) *size = 1024;
+            *line = xmlMalloc(*size);
+        }
+        if (fgets(*line, *size, list) == NULL) return 0;
+        len = strlen(*line);
+
+        /* grow the buffer until we have the complete line */
+        while (len == *size - 1 && (*line)[len - 1] != '\n')
+        {
+            *size *= 2;
+            *line = xmlRealloc(*line, *size);
+            if (fgets(*line + len, *size - len, list) == NULL) break;
+            len += strlen(*line + len);
+        }
+        while (len > 0 && ((*line)[len - 1] == '\n' || (*line)[len - 1] == '\r'))
+            (*line)[--len] = '\0';
+        if (len > 0) return 1;
+    }
+}
+
+/**
+ *  Get the file name of a local @url (a plain path or a file: URL),
+ *  returns NULL for other URLs; the result must be freed with xmlFree()
+ */
+char *
+localPath(const xmlChar *url)
+{
+    if (url == NULL) return NULL;
+    if (!xmlStrncasecmp(url, BAD_CAST "file://", 7))
+    {
+        url += 7;
+        if (!xmlStrncasecmp(url, BAD_CAST "localhost/", 10)) url += 9;
+        return xmlURIUnescapeString((const char *) url, 0, NULL);
+    }
+    if (xmlStrstr(url, BAD_CAST "://"))
+        return NULL;
+    return (char *) xmlStrdup(url);
+}
+
+static int
+jobBufferWrite(void *context, const char *buffer, int len)
+{
+    return xmlBufferAdd(context, (const xmlChar *) buffer, len) == 0?
+        len : -1;
+}
+
+/**
+ *  Create an output buffer appending to a job's @out buffer, for
+ *  libxml2 and libxslt functions that save through xmlOutputBuffer
+ */
+xmlOutputBufferPtr
+jobOutputBuffer(xmlBufferPtr out, xmlCharEncodingHandlerPtr encoder)
+{
+    return xmlOutputBufferCreateIO(jobBufferWrite, NULL, out, encoder);
+}
+
+/**
+ *  Run all items on the calling thread
+ */
+static void
+runJobsSequential(int nitems, void *shared, const jobHandlers *handlers)
+{
+    void *local = NULL;
+    int i;
+
+    if (handlers->init) local = handlers->init(shared);
+    for (i = 0; i < nitems; i++)
+    {
+        int result = handlers->run(shared, local, i, NULL);
+        if (handlers->done) handlers->done(shared, i, result, NULL);
+    }
+    if (handlers->fini) handlers->fini(shared, local);
+}
+
+#if XSTAR_THREADS
+
+typedef struct _jobSlot {
+    int ready;
+    int result;
+    xmlBufferPtr out;
+} jobSlot;
+
+typedef struct _jobPool {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int nitems;
+    int next;                 /* next item to hand out */
+    int emitted;              /* items passed to done() so far */
+    int window;
+    jobSlot *slots;
+    void *shared;
+    const jobHandlers *handlers;
+
+    /* error handlers of the calling thread, workers inherit them */
+    xmlStructuredErrorFunc serror;
+    void *serrorCtxt;
+    xmlGenericErrorFunc gerror;
+    void *gerrorCtxt;
+} jobPool;
+
+typedef struct _jobWorker {
+    pthread_t thread;
+    jobPool *pool;
+    void *local;
+} jobWorker;
+
+static void *
+jobWorkerMain(void *arg)
+{
+    jobWorker *worker = arg;
+    jobPool *pool = worker->pool;
+
+    xmlSetGenericErrorFunc(pool->gerrorCtxt, pool->gerror);
+    xmlSetStructuredErrorFunc(pool->serrorCtxt, pool->serror);
+
+    if (pool->handlers->init)
+        worker->local = pool->handlers->init(pool->shared);
+
+    for (;;)
+    {
+        int item;
+        xmlBufferPtr out;
+
+        pthread_mutex_lock(&pool->lock);
+        while (pool->next < pool->nitems &&
+               pool->next >= pool->emitted + pool->window)
+            pthread_cond_wait(&pool->cond, &pool->lock);
+        if (pool->next >= pool->nitems)
+        {
+            pthread_mutex_unlock(&pool->lock);
+            break;
+        }
+        item = pool->next++;
+        pthread_mutex_unlock(&pool->lock);
+
+        out = xmlBufferCreate();
+        xmlBufferSetAllocationScheme(out, XML_BUFFER_ALLOC_DOUBLEIT);
+        pool->slots[item].result =
+            pool->handlers->run(pool->shared, worker->local, item, out);
+
+        pthread_mutex_lock(&pool->lock);
+        pool->slots[item].out = out;
+        pool->slots[item].ready = 1;
+        pthread_cond_broadcast(&pool->cond);
+        pthread_mutex_unlock(&pool->lock);
+    }
+
+    return NULL;
+}
+
+/**
+ *  Hand items out to @njobs worker threads and collect their output
+ *  in order; returns -1 if no thread could be started at all
+ */
+static int
+runJobsThreaded(int njobs, int nitems, void *shared,
+                const jobHandlers *handlers)
+{
+    jobPool pool;
+    jobWorker *workers;
+    int i, started;
+
+    pool.nitems = nitems;
+    pool.next = 0;
+    pool.emitted = 0;
+    pool.window = njobs * JOB_WINDOW_PER_THREAD;
+    pool.slots = calloc(nitems, sizeof(*pool.slots));
+    pool.shared = shared;
+    pool.handlers = handlers;
+    pool.serror = xmlStructuredError;
+    pool.serrorCtxt = xmlStructuredErrorContext;
+    pool.gerror = xmlGenericError;
+    pool.gerrorCtxt = xmlGenericErrorContext;
+    workers = calloc(njobs, sizeof(*workers));
+    if (!pool.slots || !workers)
+    {
+        fprintf(stderr, "out of memory\n");
+        exit(EXIT_INTERNAL_ERROR);
+    }
+    pthread_mutex_init(&pool.lock, NULL);
+    pthread_cond_init(&pool.cond, NULL);
+
+    for (started = 0; started < njobs; started++)
+    {
+        workers[started].pool = &pool;
+        workers[started].local = NULL;
+        if (pthread_create(&workers[started].thread, NULL,
+                           jobWorkerMain, &workers[started]) != 0)
+            break;
+    }
+
+    if (started > 0)
+    {
+        pthread_mutex_lock(&pool.lock);
+        while (pool.emitted < nitems)
+        {
+            jobSlot *slot = &pool.slots[pool.emitted];
+            while (!slot->ready)
+                pthread_cond_wait(&pool.cond, &pool.lock);
+            pthread_mutex_unlock(&pool.lock);
+
+            if (handlers->done)
+                handlers->done(shared, pool.emitted, slot->result, slot->out);
+            xmlBufferFree(slot->out);
+            slot->out = NULL;
+
+            pthread_mutex_lock(&pool.lock);
+            pool.emitted++;
+            pthread_cond_broadcast(&pool.cond);
+        }
+        pthread_mutex_unlock(&pool.lock);
+
+        for (i = 0; i < started; i++)
+        {
+            pthread_join(workers[i].thread, NULL);
+            if (handlers->fini) handlers->fini(shared, workers[i].local);
+        }
+    }
+
+    pthread_cond_destroy(&pool.cond);
+    pthread_mutex_destroy(&pool.lock);
+    free(workers);
+    free(pool.slots);
+
+    return started > 0? 0 : -1;
+}
+
+#endif  /* XSTAR_THREADS */
+
+/**
+ *  Process @nitems items with up to @njobs threads (see jobs.h)
+ */
+void
+runJobs(int njobs, int nitems, void *shared, const jobHandlers *handlers)
+{
+    if (njobs > nitems) njobs = nitems;
+
+#if XSTAR_THREADS
+    if (njobs > 1 &&
+        runJobsThreaded(njobs, nitems, shared, handlers) == 0)
+        return;
+#endif
+
+    runJobsSequential(nitems, shared, handlers);
+}
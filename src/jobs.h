@@ -0,0 +1,70 @@
+#ifndef __JOBS_H
+#define __JOBS_H
+
+/*
+
+XMLStarlet: Command Line Toolkit to query/edit/check/transform XML documents
+
+Copyright (c) 2002-2004 Mikhail Grushinskiy.  All Rights Reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+#include <stdio.h>
+
+#include <libxml/tree.h>
+#include <libxml/xmlIO.h>
+
+/*
+ *  Run a command over many input files on several worker threads.
+ *
+ *  Every worker gets its own state from init() (called on the worker
+ *  thread, so thread local libxml2 settings may be changed there), then
+ *  run() is called for the items it picks up.  Whatever run() writes to
+ *  its buffer is handed to done() on the calling thread, strictly in
+ *  item order, together with run()'s result.  When all items are done
+ *  the workers are joined and fini() is called for each worker state in
+ *  turn, also on the calling thread, so per worker results can be merged
+ *  there without locking.
+ *
+ *  With a single job (or without thread support) everything happens on
+ *  the calling thread and run() is given a NULL buffer, meaning it may
+ *  write to stdout directly.
+ */
+
+typedef struct _jobHandlers {
+    void *(*init)(void *shared);
+    int   (*run)(void *shared, void *local, int item, xmlBufferPtr out);
+    void  (*done)(void *shared, int item, int result, xmlBufferPtr out);
+    void  (*fini)(void *shared, void *local);
+} jobHandlers;
+
+int parseJobCount(const char *str);
+
+int readListLine(FILE *list, char **line, size_t *size);
+
+char *localPath(const xmlChar *url);
+
+void runJobs(int njobs, int nitems, void *shared, const jobHandlers *handlers);
+
+xmlOutputBufferPtr jobOutputBuffer(xmlBufferPtr out,
+                                   xmlCharEncodingHandlerPtr encoder);
+
+#endif /* __JOBS_H */
@@ -0,0 +1,364 @@
+/*
+
+XMLStarlet: Command Line Toolkit to query/edit/check/transform XML documents
+
+Copyright (c) 2002-2004 Mikhail Grushinskiy.  All Rights Reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libxml/xmlmemory.h>
+#include <libxml/hash.h>
+#include <libxml/tree.h>
+#include <libxslt/imports.h>
+#include <libxslt/xsltutils.h>
+
+#include "profile.h"
+
+/* calls of a template from another one */
+typedef struct _profileEdge {
+    struct _profileEntry *caller;
+    long count;
+} profileEdge;
+
+typedef struct _profileEntry {
+    xmlChar *file;            /* where the template is defined */
+    long line;
+    xmlChar *name;
+    xmlChar *match;
+    xmlChar *mode;
+    long calls;
+    double self;              /* time spent in the template itself */
+    double total;             /* including the templates it called */
+    int state;                /* see profileTotal() */
+    profileEdge *callers;
+    int ncallers;
+} profileEntry;
+
+static profileEntry **entries = NULL;
+static int nentries = 0;
+static xmlHashTablePtr entryIndex = NULL;
+
+#define PROFILE_MSEC(t) ((t) * 1000.0 / XSLT_TIMESTAMP_TICS_PER_SEC)
+
+/**
+ *  Find (or add) the entry of template @templ
+ */
+static profileEntry *
+profileLookup(xsltTemplatePtr templ)
+{
+    const xmlChar *file = NULL;
+    char line[32];
+    long lineNo = templ->elem? xmlGetLineNo(templ->elem) : -1;
+    profileEntry *entry;
+
+    if (templ->style && templ->style->doc) file = templ->style->doc->URL;
+    if (file == NULL) file = BAD_CAST "";
+    sprintf(line, "%ld", lineNo);
+
+    if (entryIndex == NULL) entryIndex = xmlHashCreate(64);
+    entry = xmlHashLookup2(entryIndex, file, BAD_CAST line);
+    if (entry) return entry;
+
+    entry = xmlMalloc(sizeof(*entry));
+    memset(entry, 0, sizeof(*entry));
+    entry->file = xmlStrdup(file);
+    entry->line = lineNo;
+    entry->name = xmlStrdup(templ->name);
+    entry->match = xmlStrdup(templ->match);
+    entry->mode = xmlStrdup(templ->mode);
+    xmlHashAddEntry2(entryIndex, file, BAD_CAST line, entry);
+
+    entries = xmlRealloc(entries, (nentries + 1) * sizeof(*entries));
+    entries[nentries++] = entry;
+    return entry;
+}
+
+static void
+profileAddCaller(profileEntry *entry, profileEntry *caller, long count)
+{
+    int i;
+
+    for (i = 0; i < entry->ncallers; i++)
+    {
+        if (entry->callers[i].caller == caller)
+        {
+            entry->callers[i].count += count;
+            return;
+        }
+    }
+    entry->callers = xmlRealloc(entry->callers,
+                                (entry->ncallers + 1) * sizeof(*entry->callers));
+    entry->callers[entry->ncallers].caller = caller;
+    entry->callers[entry->ncallers].count = count;
+    entry->ncallers++;
+}
+
+/**
+ *  Add the counters of all templates of @cur (and its imports) to the
+ *  profile and reset them for the next transformation
+ */
+void
+profileCollect(xsltStylesheetPtr cur)
+{
+    xsltStylesheetPtr style;
+    xsltTemplatePtr templ;
+    int i;
+
+    for (style = cur; style != NULL; style = xsltNextImport(style))
+    {
+        for (templ = style->templates; templ != NULL; templ = templ->next)
+        {
+            profileEntry *entry;
+
+            if (templ->nbCalls == 0) continue;
+            entry = profileLookup(templ);
+            entry->calls += templ->nbCalls;
+            entry->self += templ->time;
+
+            /* libxslt records the callers of each template */
+            for (i = 0; i < templ->templNr; i++)
+            {
+                if (templ->templCalledTab[i] == NULL) continue;
+                profileAddCaller(entry, profileLookup(templ->templCalledTab[i]),
+                                 templ->templCountTab[i]);
+            }
+
+            templ->nbCalls = 0;
+            templ->time = 0;
+            templ->templNr = 0;
+        }
+    }
+}
+
+/**
+ *  Time spent in @entry including the templates it called; the time
+ *  of a template is split between its callers by their share of the
+ *  calls.  Calls back into a template that is still being computed
+ *  (recursion) add nothing.
+ */
+static double
+profileTotal(profileEntry *entry)
+{
+    int i, j;
+
+    if (entry->state == 2) return entry->total;
+    if (entry->state == 1) return 0;
+
+    entry->state = 1;
+    entry->total = entry->self;
+    for (i = 0; i < nentries; i++)
+    {
+        profileEntry *callee = entries[i];
+
+        for (j = 0; j < callee->ncallers; j++)
+        {
+            if (callee->callers[j].caller != entry || callee == entry)
+                continue;
+            entry->total += profileTotal(callee) *
+                callee->callers[j].count / callee->calls;
+        }
+    }
+    entry->state = 2;
+    return entry->total;
+}
+
+static int
+profileCompare(const void *a, const void *b)
+{
+    const profileEntry *x = *(profileEntry * const *) a;
+    const profileEntry *y = *(profileEntry * const *) b;
+
+    int cmp;
+
+    if (x->self != y->self) return x->self < y->self? 1 : -1;
+    if (x->calls != y->calls) return x->calls < y->calls? 1 : -1;
+    cmp = xmlStrcmp(x->file, y->file);
+    if (cmp) return cmp;
+    return x->line < y->line? -1 : x->line > y->line;
+}
+
+/**
+ *  Compute totals and sort the entries by self time
+ */
+static void
+profileSort(void)
+{
+    int i;
+
+    for (i = 0; i < nentries; i++) entries[i]->state = 0;
+    for (i = 0; i < nentries; i++) profileTotal(entries[i]);
+    if (nentries > 1)
+        qsort(entries, nentries, sizeof(*entries), profileCompare);
+}
+
+/**
+ *  Print the profile as a table, most expensive templates first
+ */
+void
+profilePrint(FILE *out)
+{
+    int i;
+
+    profileSort();
+    fprintf(out, "%5s %9s %11s %11s %10s  %s\n",
+            "rank", "calls", "self ms", "total ms", "avg ms", "template");
+    for (i = 0; i < nentries; i++)
+    {
+        profileEntry *entry = entries[i];
+
+        fprintf(out, "%5d %9ld %11.3f %11.3f %10.3f  ", i + 1, entry->calls,
+                PROFILE_MSEC(entry->self), PROFILE_MSEC(entry->total),
+                PROFILE_MSEC(entry->total) / entry->calls);
+        if (entry->name) fprintf(out, "name=\"%s\" ", (char *) entry->name);
+        if (entry->match) fprintf(out, "match=\"%s\" ", (char *) entry->match);
+        if (entry->mode) fprintf(out, "mode=\"%s\" ", (char *) entry->mode);
+        fprintf(out, "(%s:%ld)\n", (char *) entry->file, entry->line);
+    }
+}
+
+static void
+profileJsonString(FILE *out, const xmlChar *str)
+{
+    if (str == NULL)
+    {
+        fputs("null", out);
+        return;
+    }
+    putc('"', out);
+    for (; *str; str++)
+    {
+        if (*str == '"' || *str == '\\')
+            fprintf(out, "\\%c", *str);
+        else if (*str < 0x20)
+            fprintf(out, "\\u%04x", *str);
+        else
+            putc(*str, out);
+    }
+    putc('"', out);
+}
+
+static int
+profileSaveJson(const char *filename)
+{
+    FILE *out = fopen(filename, "w");
+    int i;
+
+    if (out == NULL) return -1;
+    fprintf(out, "{\"templates\": [");
+    for (i = 0; i < nentries; i++)
+    {
+        profileEntry *entry = entries[i];
+
+        fprintf(out, "%s\n  {\"rank\": %d, \"name\": ", i? "," : "", i + 1);
+        profileJsonString(out, entry->name);
+        fprintf(out, ", \"match\": ");
+        profileJsonString(out, entry->match);
+        fprintf(out, ", \"mode\": ");
+        profileJsonString(out, entry->mode);
+        fprintf(out, ", \"file\": ");
+        profileJsonString(out, entry->file);
+        fprintf(out, ", \"line\": %ld, \"calls\": %ld, "
+                "\"self\": %.3f, \"total\": %.3f}",
+                entry->line, entry->calls,
+                PROFILE_MSEC(entry->self), PROFILE_MSEC(entry->total));
+    }
+    fprintf(out, "\n]}\n");
+    return fclose(out) == 0? 0 : -1;
+}
+
+static int
+profileSaveXml(const char *filename)
+{
+    xmlDocPtr doc = xmlNewDoc(BAD_CAST "1.0");
+    xmlNodePtr root = xmlNewDocNode(doc, NULL, BAD_CAST "profile", NULL);
+    char buf[64];
+    int i, ret;
+
+    xmlDocSetRootElement(doc, root);
+    for (i = 0; i < nentries; i++)
+    {
+        profileEntry *entry = entries[i];
+        xmlNodePtr node = xmlNewChild(root, NULL, BAD_CAST "template", NULL);
+
+        sprintf(buf, "%d", i + 1);
+        xmlSetProp(node, BAD_CAST "rank", BAD_CAST buf);
+        if (entry->name) xmlSetProp(node, BAD_CAST "name", entry->name);
+        if (entry->match) xmlSetProp(node, BAD_CAST "match", entry->match);
+        if (entry->mode) xmlSetProp(node, BAD_CAST "mode", entry->mode);
+        xmlSetProp(node, BAD_CAST "file", entry->file);
+        sprintf(buf, "%ld", entry->line);
+        xmlSetProp(node, BAD_CAST "line", BAD_CAST buf);
+        sprintf(buf, "%ld", entry->calls);
+        xmlSetProp(node, BAD_CAST "calls", BAD_CAST buf);
+        sprintf(buf, "%.3f", PROFILE_MSEC(entry->self));
+        xmlSetProp(node, BAD_CAST "self", BAD_CAST buf);
+        sprintf(buf, "%.3f", PROFILE_MSEC(entry->total));
+        xmlSetProp(node, BAD_CAST "total", BAD_CAST buf);
+    }
+
+    ret = xmlSaveFormatFileEnc(filename, doc, "UTF-8", 1);
+    xmlFreeDoc(doc);
+    return ret < 0? -1 : 0;
+}
+
+/**
+ *  Save the profile to @filename, as JSON if the name ends in .json and
+ *  as XML otherwise; times are in milliseconds
+ */
+int
+profileSave(const char *filename)
+{
+    size_t len = strlen(filename);
+
+    profileSort();
+    if (len >= 5 && !strcmp(filename + len - 5, ".json"))
+        return profileSaveJson(filename);
+    return profileSaveXml(filename);
+}
+
+void
+profileFree(void)
+{
+    int i;
+
+    for (i = 0; i < nentries; i++)
+    {
+        profileEntry *entry = entries[i];
+        xmlFree(entry->file);
+        xmlFree(entry->name);
+        xmlFree(entry->match);
+        xmlFree(entry->mode);
+        xmlFree(entry->callers);
+        xmlFree(entry);
+    }
+    xmlFree(entries);
+    entries = NULL;
+    nentries = 0;
+    xmlHashFree(entryIndex, NULL);
+    entryIndex = NULL;
+}
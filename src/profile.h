@@ -0,0 +1,54 @@
+#ifndef __PROFILE_H
+#define __PROFILE_H
+
+/*
+
+XMLStarlet: Command Line Toolkit to query/edit/check/transform XML documents
+
+Copyright (c) 2002-2004 Mikhail Grushinskiy.  All Rights Reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+
+#include <stdio.h>
+
+#include <libxslt/xsltInternals.h>
+
+/*
+ *  Per template profile of XSLT transformations.
+ *
+ *  libxslt counts calls and (self) time in the templates of a compiled
+ *  stylesheet when the transformation context has profiling enabled.
+ *  profileCollect() moves those counters into a table kept here and
+ *  clears them, so a run over many documents (or over stylesheets that
+ *  are compiled again) adds up.  Templates are identified by the file and
+ *  line they are defined at.
+ */
+
+void profileCollect(xsltStylesheetPtr cur);
+
+void profilePrint(FILE *out);
+
+int profileSave(const char *filename);
+
+void profileFree(void);
+
+#endif /* __PROFILE_H */
@@ -0,0 +1,163 @@
+/*
+
+XMLStarlet: Command Line Toolkit to query/edit/check/transform XML documents
+
+Copyright (c) 2002-2004 Mikhail Grushinskiy.  All Rights Reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+
+#include <config.h>
+
+#include "scan.h"
+
+#if defined(__GNUC__) && defined(__AVX2__)
+# include <immintrin.h>
+# define SCAN_WIDTH 32
+# define SCAN_FULL 0xffffffffU
+typedef __m256i scanVec;
+# define SCAN_LOAD(p) _mm256_loadu_si256((const __m256i *) (p))
+# define SCAN_SPLAT(c) _mm256_set1_epi8((char) (c))
+# define SCAN_EQ(v, c) _mm256_cmpeq_epi8(v, c)
+# define SCAN_OR(a, b) _mm256_or_si256(a, b)
+# define SCAN_MASK(v) ((unsigned int) _mm256_movemask_epi8(v))
+#elif defined(__GNUC__) && defined(__SSE2__)
+# include <emmintrin.h>
+# define SCAN_WIDTH 16
+# define SCAN_FULL 0xffffU
+typedef __m128i scanVec;
+# define SCAN_LOAD(p) _mm_loadu_si128((const __m128i *) (p))
+# define SCAN_SPLAT(c) _mm_set1_epi8((char) (c))
+# define SCAN_EQ(v, c) _mm_cmpeq_epi8(v, c)
+# define SCAN_OR(a, b) _mm_or_si128(a, b)
+# define SCAN_MASK(v) ((unsigned int) _mm_movemask_epi8(v))
+#endif
+
+const char *
+scanChr2(const char *p, const char *end, int a, int b)
+{
+#ifdef SCAN_WIDTH
+    scanVec va = SCAN_SPLAT(a), vb = SCAN_SPLAT(b);
+
+    while (end - p >= SCAN_WIDTH)
+    {
+        scanVec v = SCAN_LOAD(p);
+        unsigned int mask = SCAN_MASK(SCAN_OR(SCAN_EQ(v, va), SCAN_EQ(v, vb)));
+        if (mask) return p + __builtin_ctz(mask);
+        p += SCAN_WIDTH;
+    }
+#endif
+    for (; p < end; p++)
+        if (*p == a || *p == b) return p;
+    return end;
+}
+
+const char *
+scanChr3(const char *p, const char *end, int a, int b, int c)
+{
+#ifdef SCAN_WIDTH
+    scanVec va = SCAN_SPLAT(a), vb = SCAN_SPLAT(b), vc = SCAN_SPLAT(c);
+
+    while (end - p >= SCAN_WIDTH)
+    {
+        scanVec v = SCAN_LOAD(p);
+        unsigned int mask = SCAN_MASK(SCAN_OR(SCAN_OR(SCAN_EQ(v, va),
+                                                      SCAN_EQ(v, vb)),
+                                              SCAN_EQ(v, vc)));
+        if (mask) return p + __builtin_ctz(mask);
+        p += SCAN_WIDTH;
+    }
+#endif
+    for (; p < end; p++)
+        if (*p == a || *p == b || *p == c) return p;
+    return end;
+}
+
+const char *
+scanChr4(const char *p, const char *end, int a, int b, int c, int d)
+{
+#ifdef SCAN_WIDTH
+    scanVec va = SCAN_SPLAT(a), vb = SCAN_SPLAT(b),
+            vc = SCAN_SPLAT(c), vd = SCAN_SPLAT(d);
+
+    while (end - p >= SCAN_WIDTH)
+    {
+        scanVec v = SCAN_LOAD(p);
+        unsigned int mask = SCAN_MASK(SCAN_OR(SCAN_OR(SCAN_EQ(v, va),
+                                                      SCAN_EQ(v, vb)),
+                                              SCAN_OR(SCAN_EQ(v, vc),
+                                                      SCAN_EQ(v, vd))));
+        if (mask) return p + __builtin_ctz(mask);
+        p += SCAN_WIDTH;
+    }
+#endif
+    for (; p < end; p++)
+        if (*p == a || *p == b || *p == c || *p == d) return p;
+    return end;
+}
+
+const char *
+scanText(const char *p, const char *end)
+{
+#ifdef SCAN_WIDTH
+    scanVec lt = SCAN_SPLAT('<'), amp = SCAN_SPLAT('&'), cr = SCAN_SPLAT('\r');
+
+    while (end - p >= SCAN_WIDTH)
+    {
+        scanVec v = SCAN_LOAD(p);
+        /* the sign bits are the non-ASCII bytes */
+        unsigned int mask = SCAN_MASK(SCAN_OR(SCAN_OR(SCAN_EQ(v, lt),
+                                                      SCAN_EQ(v, amp)),
+                                              SCAN_OR(SCAN_EQ(v, cr), v)));
+        if (mask) return p + __builtin_ctz(mask);
+        p += SCAN_WIDTH;
+    }
+#endif
+    for (; p < end; p++)
+        if (*p == '<' || *p == '&' || *p == '\r' || (*p & 0x80)) return p;
+    return end;
+}
+
+const char *
+scanSpace(const char *p, const char *end)
+{
+#ifdef SCAN_WIDTH
+    scanVec sp = SCAN_SPLAT(' '), nl = SCAN_SPLAT('\n'),
+            tab = SCAN_SPLAT('\t'), cr = SCAN_SPLAT('\r');
+
+    /* most runs of white space are short, look at them bytewise first */
+    if (p < end && !SCAN_IS_SPACE(*p)) return p;
+    while (end - p >= SCAN_WIDTH)
+    {
+        scanVec v = SCAN_LOAD(p);
+        unsigned int mask = ~SCAN_MASK(SCAN_OR(SCAN_OR(SCAN_EQ(v, sp),
+                                                       SCAN_EQ(v, nl)),
+                                               SCAN_OR(SCAN_EQ(v, tab),
+                                                       SCAN_EQ(v, cr))))
+                            & SCAN_FULL;
+        if (mask) return p + __builtin_ctz(mask);
+        p += SCAN_WIDTH;
+    }
+#endif
+    for (; p < end; p++)
+        if (!SCAN_IS_SPACE(*p)) return p;
+    return end;
+}
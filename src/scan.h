@@ -0,0 +1,54 @@
+#ifndef __SCAN_H
+#define __SCAN_H
+
+/*
+
+XMLStarlet: Command Line Toolkit to query/edit/check/transform XML documents
+
+Copyright (c) 2002-2004 Mikhail Grushinskiy.  All Rights Reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+/*
+ *  Byte scanning primitives for the commands that work on the raw text
+ *  of a document instead of a tree.  They use SSE2 or AVX2 when the
+ *  compiler targets them (e.g. CFLAGS=-march=native for AVX2) and plain
+ *  loops otherwise.  All of them return @end when nothing is found.
+ */
+
+/* first occurrence of byte @a or @b in [@p, @end) */
+const char *scanChr2(const char *p, const char *end, int a, int b);
+
+/* first occurrence of byte @a, @b or @c in [@p, @end) */
+const char *scanChr3(const char *p, const char *end, int a, int b, int c);
+
+/* first occurrence of byte @a, @b, @c or @d in [@p, @end) */
+const char *scanChr4(const char *p, const char *end, int a, int b, int c, int d);
+
+/* first '<', '&', carriage return or non-ASCII byte in [@p, @end) */
+const char *scanText(const char *p, const char *end);
+
+/* first byte in [@p, @end) that is not XML white space */
+const char *scanSpace(const char *p, const char *end);
+
+#define SCAN_IS_SPACE(c) ((c) == ' ' || (c) == '\n' || (c) == '\t' || (c) == '\r')
+
+#endif /* __SCAN_H */
@@ -6,6 +6,7 @@ src/edit-usage.txt\
 src/elem-usage.txt\
 src/escape-usage.txt\
 src/format-usage.txt\
+src/infer-usage.txt\
 src/ls-usage.txt\
 src/pyx-usage.txt\
 src/select-usage.txt\
@@ -21,6 +22,7 @@ src/edit-usage.c\
 src/elem-usage.c\
 src/escape-usage.c\
 src/format-usage.c\
+src/infer-usage.c\
 src/ls-usage.c\
 src/pyx-usage.c\
 src/select-usage.c\
@@ -29,9 +31,19 @@ src/unescape-usage.c\
 src/validate-usage.c
 
 xml_SOURCES =\
+src/digest.c\
+src/digest.h\
 src/escape.h\
+src/jobs.c\
+src/jobs.h\
+src/profile.c\
+src/profile.h\
+src/scan.c\
+src/scan.h\
 src/trans.c\
 src/trans.h\
+src/xinclude.c\
+src/xinclude.h\
 src/xml.c\
 src/xml_C14N.c\
 src/xml_depyx.c\
@@ -39,6 +51,7 @@ src/xml_edit.c\
 src/xml_elem.c\
 src/xml_escape.c\
 src/xml_format.c\
+src/xml_infer.c\
 src/xml_ls.c\
 src/xml_pyx.c\
 src/xml_select.c\
@@ -1,8 +1,14 @@
 /*  $Id: trans.c,v 1.19 2004/11/22 02:28:21 mgrouch Exp $  */
 
 #include <config.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
 #include "trans.h"
 #include "xmlstar.h"
+#include "jobs.h"
+#include "profile.h"
+#include "xinclude.h"
 
 /*
  *  This code is based on xsltproc by Daniel Veillard (daniel@veillard.com)
@@ -23,6 +29,16 @@ xsltInitOptions(xsltOptionsPtr ops)
     ops->show_extensions = 0;
     ops->noblanks = 0;
     ops->embed = 0;
+    ops->jobs = 1;
+    ops->output_dir = NULL;
+    ops->output_name = NULL;
+    ops->files_from = NULL;
+    ops->profile = 0;
+    ops->profile_file = NULL;
+    ops->params_file = NULL;
+#ifdef XSLT_STREAM_SPLIT
+    ops->stream_split = NULL;
+#endif
 #ifdef LIBXML_XINCLUDE_ENABLED
     ops->xinclude = 0;
 #endif
@@ -74,32 +90,175 @@ xsltInitLibXml(xsltOptionsPtr ops)
 #endif
 }
 
-/* get result of XSL transformation */
-xmlDocPtr
-xsltTransform(xsltOptionsPtr ops, xmlDocPtr doc, const char** params,
-            xsltStylesheetPtr cur, const char *filename)
+void
+xsltInitParams(xsltParamsPtr params)
 {
-    xsltTransformContextPtr ctxt;
-    xmlDocPtr res;
+    params->items = NULL;
+    params->count = 0;
+}
 
-    if (ops->omit_decl)
+/**
+ *  Add parameter @name (of @len bytes) with a string @value, or an
+ *  XPath expression if @xpath is set.  A name given twice is reported
+ *  by libxslt when the stylesheet is applied.  Returns -1 if the
+ *  expression does not compile.
+ */
+int
+xsltAddParam(xsltParamsPtr params, const xmlChar *name, int len,
+             const xmlChar *value, int xpath)
+{
+    xmlXPathCompExprPtr comp = NULL;
+    xsltParam *param;
+
+    if (xpath)
     {
-        cur->omitXmlDeclaration = 1;
+        comp = xmlXPathCompile(value);
+        if (comp == NULL) return -1;
+    }
+
+    params->items = xmlRealloc(params->items,
+                               (params->count + 1) * sizeof(*params->items));
+    param = &params->items[params->count++];
+    param->name = xmlStrndup(name, len);
+    param->value = xmlStrdup(value);
+    param->comp = comp;
+    return 0;
+}
+
+/**
+ *  Check whether the first @count parameters of @params have @name
+ *  (of @len bytes)
+ */
+int
+xsltHasParam(xsltParamsPtr params, int count, const xmlChar *name, int len)
+{
+    int i;
+
+    for (i = 0; i < count && i < params->count; i++)
+    {
+        const xmlChar *other = params->items[i].name;
+        if (xmlStrlen(other) == len && !xmlStrncmp(other, name, len))
+            return 1;
+    }
+    return 0;
+}
+
+void
+xsltFreeParams(xsltParamsPtr params)
+{
+    int i;
+
+    for (i = 0; i < params->count; i++)
+    {
+        xmlFree(params->items[i].name);
+        xmlFree(params->items[i].value);
+        if (params->items[i].comp)
+            xmlXPathFreeCompExpr(params->items[i].comp);
+    }
+    xmlFree(params->items);
+    xsltInitParams(params);
+}
+
+/* name of the XPath function that returns the current parameter */
+#define XSLT_PARAM_FUNCTION "xmlstarlet-param"
+
+/**
+ *  XPath function returning the value of the user parameter being set,
+ *  its expression compiled once is evaluated for the current document
+ */
+static void
+xsltParamFunction(xmlXPathParserContextPtr ctxt, int nargs)
+{
+    xsltTransformContextPtr tctxt = xsltXPathGetTransformContext(ctxt);
+    xsltParam *param = tctxt->_private;
+    xmlXPathObjectPtr value;
+
+    CHECK_ARITY(0);
+    if (param == NULL)
+    {
+        /* called again from the expression itself */
+        xmlXPathErr(ctxt, XPATH_UNKNOWN_FUNC_ERROR);
+        return;
     }
 
+    tctxt->_private = NULL;
+    value = xmlXPathCompiledEval(param->comp, ctxt->context);
+    tctxt->_private = param;
+    if (value == NULL)
+    {
+        /* the expression has reported its error */
+        ctxt->error = XPATH_EXPR_ERROR;
+        return;
+    }
+    valuePush(ctxt, value);
+}
+
+/**
+ *  Set the user parameters of transformation @ctxt on @doc with
+ *  xsltQuoteOneUserParam() and xsltEvalOneUserParam().  XPath ones are
+ *  passed as a call of XSLT_PARAM_FUNCTION, so their expressions are
+ *  not parsed again for every document.
+ */
+static int
+xsltSetParams(xsltTransformContextPtr ctxt, xmlDocPtr doc,
+              xsltParamsPtr params)
+{
+    int i, ret = 0;
+
+    if (params == NULL || params->count == 0) return 0;
+
+    /* the context node of the expressions */
+    ctxt->initialContextDoc = doc;
+    ctxt->initialContextNode = (xmlNodePtr) doc;
+    xmlXPathRegisterFunc(ctxt->xpathCtxt, BAD_CAST XSLT_PARAM_FUNCTION,
+                         xsltParamFunction);
+
+    for (i = 0; i < params->count && ret == 0; i++)
+    {
+        xsltParam *param = &params->items[i];
+
+        ctxt->_private = param;
+        if (param->comp)
+            ret = xsltEvalOneUserParam(ctxt, param->name,
+                                       BAD_CAST XSLT_PARAM_FUNCTION "()");
+        else
+            ret = xsltQuoteOneUserParam(ctxt, param->name, param->value);
+    }
+
+    /* not visible to the stylesheet */
+    xmlXPathRegisterFunc(ctxt->xpathCtxt, BAD_CAST XSLT_PARAM_FUNCTION, NULL);
+    ctxt->_private = NULL;
+
+    if (ret != 0 || ctxt->state != XSLT_STATE_OK) return -1;
+    return 0;
+}
+
+/* apply stylesheet to @doc, @status is set on errors */
+static xmlDocPtr
+xsltTransformDoc(xsltOptionsPtr ops, xmlDocPtr doc, xsltParamsPtr params,
+            xsltStylesheetPtr cur, const char *filename, int *status)
+{
+    xsltTransformContextPtr ctxt;
+    xmlDocPtr res;
+
 #ifdef LIBXML_XINCLUDE_ENABLED
-    if (ops->xinclude) xmlXIncludeProcess(doc);
+    if (ops->xinclude) xincludeProcess(doc);
 #endif
 
     ctxt = xsltNewTransformContext(cur, doc);
     if (ctxt == NULL) return NULL;
+    if (ops->profile) ctxt->profile = 1;
 
-    res = xsltApplyStylesheetUser(cur, doc, params, NULL, NULL, ctxt);
+    if (xsltSetParams(ctxt, doc, params) < 0)
+        res = NULL;
+    else
+        res = xsltApplyStylesheetUser(cur, doc, NULL, NULL, NULL, ctxt);
+    if (ops->profile) profileCollect(cur);
         
     if (ctxt->state == XSLT_STATE_ERROR)
-        errorno = 9;
+        *status = 9;
     if (ctxt->state == XSLT_STATE_STOPPED)
-        errorno = 10;
+        *status = 10;
     xsltFreeTransformContext(ctxt);
     xmlFreeDoc(doc);
     if (res == NULL)
@@ -109,16 +268,118 @@ xsltTransform(xsltOptionsPtr ops, xmlDocPtr doc, const char** params,
     return res;
 }
 
+/* get result of XSL transformation */
+xmlDocPtr
+xsltTransform(xsltOptionsPtr ops, xmlDocPtr doc, xsltParamsPtr params,
+            xsltStylesheetPtr cur, const char *filename)
+{
+    int status = 0;
+    xmlDocPtr res;
+
+    if (ops->omit_decl)
+    {
+        cur->omitXmlDeclaration = 1;
+    }
+
+    res = xsltTransformDoc(ops, doc, params, cur, filename, &status);
+    if (status) errorno = status;
+    return res;
+}
+
+/**
+ *  Build the name of the --output-dir file for input @filename, the
+ *  @number-th input document and @record-th --stream-split record of
+ *  it; the result must be freed with xmlFree()
+ */
+static xmlChar *
+xsltResultFilename(xsltOptionsPtr ops, const char *filename, int number,
+                   int record)
+{
+    const char *pattern = ops->output_name;
+    const char *base, *ext, *p;
+    xmlBufferPtr buf;
+    xmlChar *name;
+    char num[32];
+
+    base = strrchr(filename, '/');
+    base = base? base + 1 : filename;
+    if (!strcmp(base, "-")) base = "stdin";
+    ext = strrchr(base, '.');
+    if (ext == NULL || ext == base) ext = base + strlen(base);
+
+    if (pattern == NULL)
+    {
+        pattern = "%f";
+#ifdef XSLT_STREAM_SPLIT
+        /* records of one input must not overwrite each other */
+        if (ops->stream_split) pattern = "%r-%f";
+#endif
+    }
+
+    buf = xmlBufferCreate();
+    xmlBufferCCat(buf, ops->output_dir);
+    xmlBufferCCat(buf, "/");
+    for (p = pattern; *p; p++)
+    {
+        if (*p == '%' && p[1] == 'f')
+            xmlBufferCCat(buf, base);
+        else if (*p == '%' && p[1] == 'b')
+            xmlBufferAdd(buf, BAD_CAST base, ext - base);
+        else if (*p == '%' && p[1] == 'n')
+        {
+            sprintf(num, "%d", number);
+            xmlBufferCCat(buf, num);
+        }
+        else if (*p == '%' && p[1] == 'r')
+        {
+            sprintf(num, "%d", record);
+            xmlBufferCCat(buf, num);
+        }
+        else if (*p == '%' && p[1] == '%')
+            xmlBufferCCat(buf, "%");
+        else
+        {
+            xmlBufferAdd(buf, BAD_CAST p, 1);
+            continue;
+        }
+        p++;
+    }
+
+    name = xmlStrdup(xmlBufferContent(buf));
+    xmlBufferFree(buf);
+    return name;
+}
+
+/**
+ *  Save result document of the @number-th input (its @record-th record
+ *  with --stream-split) to its --output-dir file, or to stdout
+ */
+static int
+xsltSaveResult(xsltOptionsPtr ops, xmlDocPtr res, xsltStylesheetPtr cur,
+               const char *filename, int number, int record)
+{
+    xmlChar *name;
+    int ret;
+
+    if (!ops->output_dir)
+        return xsltSaveResultToFile(stdout, res, cur);
+
+    name = xsltResultFilename(ops, filename, number, record);
+    ret = xsltSaveResultToFilename((const char *) name, res, cur, 0);
+    xmlFree(name);
+    return ret;
+}
+
 /**
  *  Run stylesheet on XML document
  */
 void
-xsltProcess(xsltOptionsPtr ops, xmlDocPtr doc, const char** params,
-            xsltStylesheetPtr cur, const char *filename)
+xsltProcess(xsltOptionsPtr ops, xmlDocPtr doc, xsltParamsPtr params,
+            xsltStylesheetPtr cur, const char *filename, int number)
 {
     xmlDocPtr res = xsltTransform(ops, doc, params, cur, filename);
 
-    if (res && xsltSaveResultToFile(stdout, res, cur) < 0)
+    if (res && xsltSaveResult(ops, res, cur, filename, number, 1) < 0)
     {
         errorno = EXIT_LIB_ERROR;
     }
@@ -126,15 +387,439 @@ xsltProcess(xsltOptionsPtr ops, xmlDocPtr doc, const char** params,
     xmlFreeDoc(res);
 }
 
+/*
+ *  A run of one compiled stylesheet over many documents, shared by
+ *  the transformation jobs (the stylesheet is only read by them)
+ */
+typedef struct _xsltJob {
+    xsltOptionsPtr ops;
+    xsltParamsPtr params;
+    xsltStylesheetPtr cur;
+    char **docs;
+    int options;              /* parser options for XML input */
+    int html_opts;            /* parser options for HTML input */
+#ifdef XSLT_STREAM_SPLIT
+    xmlPatternPtr split;      /* records to transform one at a time */
+#endif
+} xsltJob;
+
+/**
+ *  Save result document @res into a job buffer, in the output
+ *  encoding of the stylesheet as xsltSaveResultToFile() would
+ */
+static int
+xsltSaveResultToJobBuffer(xmlBufferPtr out, xmlDocPtr res,
+                          xsltStylesheetPtr cur)
+{
+    const xmlChar *encoding;
+    xmlCharEncodingHandlerPtr encoder = NULL;
+    xmlOutputBufferPtr buf;
+    int ret;
+
+    XSLT_GET_IMPORT_PTR(encoding, cur, encoding)
+    if (encoding != NULL)
+    {
+        encoder = xmlFindCharEncodingHandler((const char *) encoding);
+        if (encoder != NULL &&
+            xmlStrEqual(BAD_CAST encoder->name, BAD_CAST "UTF-8"))
+            encoder = NULL;
+    }
+    buf = jobOutputBuffer(out, encoder);
+    if (buf == NULL) return -1;
+    xsltSaveResultTo(buf, res, cur);
+    ret = xmlOutputBufferClose(buf);
+    return ret;
+}
+
+/**
+ *  Save the result for the @record-th record of the @number-th input
+ *  to its own file with --output-dir, otherwise to @out or stdout
+ */
+static int
+xsltSaveJobResult(xsltJob *job, xmlDocPtr res, const char *filename,
+                  int number, int record, xmlBufferPtr out)
+{
+    if (out && !job->ops->output_dir)
+        return xsltSaveResultToJobBuffer(out, res, job->cur);
+    return xsltSaveResult(job->ops, res, job->cur, filename, number, record);
+}
+
+#ifdef XSLT_STREAM_SPLIT
+/**
+ *  Compile the --stream-split @expr, its prefixes are resolved with
+ *  the namespace declarations on the stylesheet's root element
+ */
+static xmlPatternPtr
+xsltCompileSplit(const char *expr, xsltStylesheetPtr cur)
+{
+    const xmlChar **namespaces;
+    xmlNodePtr root = xmlDocGetRootElement(cur->doc);
+    xmlNsPtr ns, nsDef = root? root->nsDef : NULL;
+    xmlPatternPtr pattern;
+    int n = 0;
+
+    for (ns = nsDef; ns; ns = ns->next) n++;
+    namespaces = xmlMalloc((2 * n + 2) * sizeof(*namespaces));
+    if (namespaces == NULL) return NULL;
+
+    n = 0;
+    for (ns = nsDef; ns; ns = ns->next)
+    {
+        if (ns->prefix == NULL) continue;
+        namespaces[n++] = ns->href;
+        namespaces[n++] = ns->prefix;
+    }
+    namespaces[n++] = NULL;
+    namespaces[n++] = NULL;
+
+    pattern = xmlPatterncompile(BAD_CAST expr, NULL, XML_PATTERN_XPATH,
+                                namespaces);
+    xmlFree(namespaces);
+    return pattern;
+}
+
+/**
+ *  Transform every element of @filename, the @number-th input, matching
+ *  the --stream-split pattern as a document of its own.  The input is
+ *  read with xmlTextReader and each record is freed once it is
+ *  transformed, so only one record has to fit into memory.
+ */
+static int
+xsltStreamDoc(xsltJob *job, const char *filename, int number,
+              xmlBufferPtr out)
+{
+    xmlTextReaderPtr reader;
+    int ret, status = 0, record = 0;
+
+    reader = xmlReaderForFile(filename, NULL, job->options);
+    if (reader == NULL)
+    {
+        fprintf(stderr, "unable to parse %s\n", filename);
+        return 6;
+    }
+
+    ret = xmlTextReaderRead(reader);
+    while (ret == 1)
+    {
+        xmlNodePtr node = xmlTextReaderCurrentNode(reader);
+        xmlDocPtr doc, res;
+
+        if (xmlTextReaderNodeType(reader) != XML_READER_TYPE_ELEMENT ||
+            xmlPatternMatch(job->split, node) != 1)
+        {
+            ret = xmlTextReaderRead(reader);
+            continue;
+        }
+
+        node = xmlTextReaderExpand(reader);
+        if (node == NULL)
+        {
+            ret = -1;
+            break;
+        }
+
+        /* in-scope namespaces of the record are declared on the copy */
+        doc = xmlNewDoc(BAD_CAST "1.0");
+        doc->URL = xmlStrdup(BAD_CAST filename);
+        xmlDocSetRootElement(doc, xmlDocCopyNode(node, doc, 1));
+
+        res = xsltTransformDoc(job->ops, doc, job->params, job->cur,
+                               filename, &status);
+        record++;
+        if (res)
+        {
+            if (xsltSaveJobResult(job, res, filename, number, record, out) < 0)
+                status = EXIT_LIB_ERROR;
+            xmlFreeDoc(res);
+        }
+
+        ret = xmlTextReaderNext(reader);
+    }
+    xmlFreeTextReader(reader);
+
+    if (ret < 0)
+    {
+        fprintf(stderr, "unable to parse %s\n", filename);
+        status = 6;
+    }
+    return status;
+}
+#endif
+
+/**
+ *  Transform input document @filename, the @number-th one
+ */
+static int
+xsltRunFile(xsltJob *job, const char *filename, int number, xmlBufferPtr out)
+{
+    xmlDocPtr doc, res;
+    int status = 0;
+
+#ifdef XSLT_STREAM_SPLIT
+    if (job->split) return xsltStreamDoc(job, filename, number, out);
+#endif
+
+#ifdef LIBXML_HTML_ENABLED
+    if (job->ops->html) doc = readHtml(filename, job->html_opts);
+    else
+#endif
+        doc = readXml(filename, job->options);
+
+    if (doc == NULL)
+    {
+        fprintf(stderr, "unable to parse %s\n", filename);
+        return 6;
+    }
+
+    res = xsltTransformDoc(job->ops, doc, job->params, job->cur,
+                           filename, &status);
+    if (res)
+    {
+        if (xsltSaveJobResult(job, res, filename, number, 1, out) < 0)
+            status = EXIT_LIB_ERROR;
+        xmlFreeDoc(res);
+    }
+
+    return status;
+}
+
+static int
+xsltRunDoc(void *shared, void *local, int item, xmlBufferPtr out)
+{
+    xsltJob *job = shared;
+    return xsltRunFile(job, job->docs[item], item + 1, out);
+}
+
+static void
+xsltDoneDoc(void *shared, int item, int status, xmlBufferPtr out)
+{
+    if (out)
+        fwrite(xmlBufferContent(out), 1, xmlBufferLength(out), stdout);
+    if (status) errorno = status;
+}
+
+/*
+ *  A file the compiled stylesheet was read from
+ */
+typedef struct _xsltDep {
+    char *path;
+    time_t mtime;
+    long size;
+} xsltDep;
+
+typedef struct _xsltDeps {
+    xsltDep *files;
+    int count;
+} xsltDeps;
+
+/**
+ *  Remember the modification time of stylesheet module @url, modules
+ *  that are not local files cannot be checked and are left out
+ */
+static void
+xsltAddDep(xsltDeps *deps, const xmlChar *url)
+{
+#if HAVE_STAT
+    struct stat st;
+    xsltDep *dep;
+    char *path;
+
+    path = localPath(url);
+    if (path == NULL) return;
+
+    if (stat(path, &st) != 0)
+    {
+        xmlFree(path);
+        return;
+    }
+    deps->files = xmlRealloc(deps->files,
+                             (deps->count + 1) * sizeof(*deps->files));
+    dep = &deps->files[deps->count++];
+    dep->path = path;
+    dep->mtime = st.st_mtime;
+    dep->size = (long) st.st_size;
+#endif
+}
+
+/**
+ *  Collect the files of stylesheet @style with all its includes and
+ *  (recursively) imports
+ */
+static void
+xsltCollectDeps(xsltDeps *deps, xsltStylesheetPtr style)
+{
+    xsltDocumentPtr inc;
+    xsltStylesheetPtr imp;
+
+    if (style->doc) xsltAddDep(deps, style->doc->URL);
+    for (inc = style->docList; inc; inc = inc->next)
+        if (inc->doc) xsltAddDep(deps, inc->doc->URL);
+    for (imp = style->imports; imp; imp = imp->next)
+        xsltCollectDeps(deps, imp);
+}
+
+static void
+xsltFreeDeps(xsltDeps *deps)
+{
+    int i;
+    for (i = 0; i < deps->count; i++)
+        xmlFree(deps->files[i].path);
+    xmlFree(deps->files);
+    deps->files = NULL;
+    deps->count = 0;
+}
+
+/**
+ *  Check whether any file of the import graph changed since it was read
+ */
+static int
+xsltDepsChanged(const xsltDeps *deps)
+{
+#if HAVE_STAT
+    struct stat st;
+    int i;
+
+    for (i = 0; i < deps->count; i++)
+    {
+        const xsltDep *dep = &deps->files[i];
+        if (stat(dep->path, &st) != 0 ||
+            st.st_mtime != dep->mtime || (long) st.st_size != dep->size)
+            return 1;
+    }
+#endif
+    return 0;
+}
+
+/**
+ *  Compile stylesheet document @style, sets errorno on failure
+ */
+static xsltStylesheetPtr
+xsltCompile(xsltOptionsPtr ops, xmlDocPtr style)
+{
+    xsltStylesheetPtr cur = xsltParseStylesheetDoc(style);
+
+    if (cur == NULL)
+    {
+        xmlFreeDoc(style);
+        errorno = 5;
+        return NULL;
+    }
+    if (cur->errors != 0)
+    {
+        xsltFreeStylesheet(cur);
+        errorno = 5;
+        return NULL;
+    }
+
+    if (ops->omit_decl)
+        cur->omitXmlDeclaration = 1;
+    return cur;
+}
+
+/**
+ *  Transform the files named in @listname, one per line, as they come
+ *  in.  The compiled stylesheet stays loaded between files, it is only
+ *  compiled again when one of the files it was read from (including
+ *  imported and included modules) is modified.  Results are flushed
+ *  after every file so the caller can wait for them on a pipe.  The
+ *  files are numbered on from the @count command line inputs.
+ */
+static void
+xsltFilesFrom(xsltJob *job, const char *xsl, const char *listname,
+              int count)
+{
+    FILE *list = stdin;
+    xsltDeps deps;
+    char *line = NULL;
+    size_t size = 0;
+    int number = count;
+
+    if (strcmp(listname, "-"))
+    {
+        list = fopen(listname, "r");
+        if (list == NULL)
+        {
+            fprintf(stderr, "error: could not open: %s\n", listname);
+            errorno = EXIT_BAD_FILE;
+            return;
+        }
+    }
+
+    deps.files = NULL;
+    deps.count = 0;
+    xsltCollectDeps(&deps, job->cur);
+
+    while (readListLine(list, &line, &size))
+    {
+        int status;
+
+        if (xsltDepsChanged(&deps))
+        {
+            xmlDocPtr style = readXml(xsl, job->options);
+            xsltStylesheetPtr cur = NULL;
+
+            if (style == NULL)
+            {
+                fprintf(stderr,  "cannot parse %s\n", xsl);
+                errorno = 4;
+            }
+            else
+                cur = xsltCompile(job->ops, style);
+
+#ifdef XSLT_STREAM_SPLIT
+            /* its prefixes come from the new stylesheet */
+            if (cur != NULL && job->split)
+            {
+                xmlPatternPtr split =
+                    xsltCompileSplit(job->ops->stream_split, cur);
+                if (split == NULL)
+                {
+                    fprintf(stderr, "invalid --stream-split pattern %s\n",
+                            job->ops->stream_split);
+                    errorno = EXIT_BAD_ARGS;
+                    xsltFreeStylesheet(cur);
+                    cur = NULL;
+                }
+                else
+                {
+                    xmlFreePattern(job->split);
+                    job->split = split;
+                }
+            }
+#endif
+
+            /* keep the old stylesheet until the new one compiles */
+            if (cur != NULL)
+            {
+                xsltFreeStylesheet(job->cur);
+                job->cur = cur;
+                xsltFreeDeps(&deps);
+                xsltCollectDeps(&deps, cur);
+            }
+        }
+
+        status = xsltRunFile(job, line, ++number, NULL);
+        if (status) errorno = status;
+        fflush(stdout);
+    }
+    xmlFree(line);
+    xsltFreeDeps(&deps);
+
+    if (list != stdin) fclose(list);
+}
+
 /**
  *  run XSLT on documents
  */
-int xsltRun(xsltOptionsPtr ops, char* xsl, const char** params,
+int xsltRun(xsltOptionsPtr ops, char* xsl, xsltParamsPtr params,
             int count, char **docs)
 {
     xsltStylesheetPtr cur = NULL;
     xmlDocPtr doc, style;
     int i, options = 0, html_opts = 0;
+#ifdef XSLT_STREAM_SPLIT
+    xmlPatternPtr split = NULL;
+#endif
 
     options = XSLT_PARSE_OPTIONS;
     if (ops->noval)
@@ -162,7 +847,7 @@ int xsltRun(xsltOptionsPtr ops, char* xsl, const char** params,
             if (cur != NULL)
             {
                 /* it is an embedded stylesheet */
-                xsltProcess(ops, style, params, cur, xsl);
+                xsltProcess(ops, style, params, cur, xsl, 0);
                 xsltFreeStylesheet(cur);
                 cur = NULL;
             }            
@@ -179,7 +864,7 @@ int xsltRun(xsltOptionsPtr ops, char* xsl, const char** params,
                 if (cur != NULL)
                 {
                     /* it is an embedded stylesheet */
-                    xsltProcess(ops, style, params, cur, docs[i]);
+                    xsltProcess(ops, style, params, cur, docs[i], i + 1);
                     xsltFreeStylesheet(cur);
                     cur = NULL;
                 }
@@ -187,21 +872,7 @@ int xsltRun(xsltOptionsPtr ops, char* xsl, const char** params,
             goto done;
         }
         
-        cur = xsltParseStylesheetDoc(style);
-        if (cur != NULL)
-        {
-            if (cur->errors != 0)
-            {
-                errorno = 5;
-                goto done;
-            }
-        }
-        else
-        {
-            xmlFreeDoc(style);
-            errorno = 5;
-            goto done;
-        }
+        cur = xsltCompile(ops, style);
     }
 
     /*
@@ -209,27 +880,54 @@ int xsltRun(xsltOptionsPtr ops, char* xsl, const char** params,
      */
     if ((cur != NULL) && (cur->errors == 0))
     {
-        for (i=0; i<count; i++)
-        {
-            doc = NULL;
-#ifdef LIBXML_HTML_ENABLED
-            if (ops->html) doc = readHtml(docs[i], html_opts);
-            else
+        static const jobHandlers xsltHandlers =
+            { NULL, xsltRunDoc, xsltDoneDoc, NULL };
+        xsltJob job;
+
+#ifdef LIBXML_XINCLUDE_ENABLED
+        /* shared by all documents of the run */
+        if (ops->xinclude) xincludeCacheInit();
 #endif
-            {
-                doc = readXml(docs[i], options);
-            }
 
-            if (doc == NULL)
+        /* the profile counters live in the shared stylesheet */
+        if (ops->profile) ops->jobs = 1;
+
+        job.ops = ops;
+        job.params = params;
+        job.cur = cur;
+        job.docs = docs;
+        job.options = options;
+        job.html_opts = html_opts;
+#ifdef XSLT_STREAM_SPLIT
+        if (ops->stream_split
+#ifdef LIBXML_HTML_ENABLED
+            && !ops->html
+#endif
+           )
+        {
+            split = xsltCompileSplit(ops->stream_split, cur);
+            if (split == NULL)
             {
-                fprintf(stderr, "unable to parse %s\n", docs[i]);
-                errorno = 6;
-                continue;
+                fprintf(stderr, "invalid --stream-split pattern %s\n",
+                        ops->stream_split);
+                errorno = EXIT_BAD_ARGS;
+                goto done;
             }
-            xsltProcess(ops, doc, params, cur, docs[i]);
         }
+        job.split = split;
+#endif
+        runJobs(ops->jobs, count, &job, &xsltHandlers);
 
-        if (count == 0)
+#ifdef XSLT_STREAM_SPLIT
+        if (count == 0 && job.split && !ops->files_from)
+        {
+            /* stdin */
+            int status = xsltStreamDoc(&job, "-", 1, NULL);
+            if (status) errorno = status;
+        }
+        else
+#endif
+        if (count == 0 && !ops->files_from)
         {
             /* stdin */
             doc = NULL;
@@ -238,15 +936,42 @@ int xsltRun(xsltOptionsPtr ops, char* xsl, const char** params,
             else
 #endif
                 doc = readXml("-", options);
-            xsltProcess(ops, doc, params, cur, "-");
+            xsltProcess(ops, doc, params, cur, "-", 1);
+        }
+
+        if (ops->files_from)
+        {
+            xsltFilesFrom(&job, xsl, ops->files_from, count);
+            cur = job.cur;
+#ifdef XSLT_STREAM_SPLIT
+            split = job.split;
+#endif
         }
     }
 
 done:
 
+    if (ops->profile)
+    {
+        if (ops->profile_file == NULL)
+            profilePrint(stderr);
+        else if (profileSave(ops->profile_file) < 0)
+        {
+            fprintf(stderr, "cannot write profile to %s\n", ops->profile_file);
+            errorno = EXIT_LIB_ERROR;
+        }
+        profileFree();
+    }
+
     /*
      *  Clean up
      */
+#ifdef LIBXML_XINCLUDE_ENABLED
+    if (ops->xinclude) xincludeCacheFree();
+#endif
+#ifdef XSLT_STREAM_SPLIT
+    if (split != NULL) xmlFreePattern(split);
+#endif
     if (cur != NULL) xsltFreeStylesheet(cur);
 
     return(errorno);
@@ -36,12 +36,16 @@ THE SOFTWARE.
 #include <libxml/xinclude.h>
 #include <libxml/parserInternals.h>
 #include <libxml/uri.h>
+#include <libxml/xpath.h>
+#include <libxml/xpathInternals.h>
 
 #include <libxslt/xslt.h>
 #include <libxslt/xsltInternals.h>
 #include <libxslt/transform.h>
 #include <libxslt/xsltutils.h>
 #include <libxslt/extensions.h>
+#include <libxslt/imports.h>
+#include <libxslt/variables.h>
 #include <libexslt/exslt.h>
 
 #ifdef LIBXML_XINCLUDE_ENABLED
@@ -50,10 +54,32 @@ THE SOFTWARE.
 #ifdef LIBXML_CATALOG_ENABLED
 #include <libxml/catalog.h>
 #endif
+#if defined(LIBXML_READER_ENABLED) && defined(LIBXML_PATTERN_ENABLED)
+#define XSLT_STREAM_SPLIT
+#include <libxml/xmlreader.h>
+#include <libxml/pattern.h>
+#endif
 
-#define MAX_PARAMETERS 256
 #define MAX_PATHS 256
 
+/*
+ *  A stylesheet parameter given by the user, either a string or an
+ *  XPath expression, which is compiled once and evaluated for every
+ *  input document
+ */
+typedef struct _xsltParam {
+    xmlChar *name;            /* QName or {uri}local-name */
+    xmlChar *value;           /* string value or XPath expression */
+    xmlXPathCompExprPtr comp; /* NULL for string parameters */
+} xsltParam;
+
+typedef struct _xsltParams {
+    xsltParam *items;
+    int count;
+} xsltParams;
+
+typedef xsltParams *xsltParamsPtr;
+
 typedef struct _xsltOptions {
     int noval;                /* do not validate against DTDs or schemas */
     int nonet;                /* refuse to fetch DTDs or entities over network */
@@ -61,6 +87,16 @@ typedef struct _xsltOptions {
     int omit_decl;            /* omit xml declaration */
     int noblanks;             /* Remove insignificant spaces from XML tree */
     int embed;                /* Allow applying embedded stylesheet */
+    int jobs;                 /* number of documents to transform at once */
+    const char *output_dir;   /* write every result to its own file here */
+    const char *output_name;  /* template for the names of those files */
+    const char *files_from;   /* list of further input files, "-" is stdin */
+    int profile;              /* profile templates */
+    const char *profile_file; /* save the profile here instead of stderr */
+    const char *params_file;  /* read parameters from this file */
+#ifdef XSLT_STREAM_SPLIT
+    const char *stream_split; /* pattern of records to transform separately */
+#endif
 #ifdef LIBXML_XINCLUDE_ENABLED
     int xinclude;             /* do XInclude processing on input documents */
 #endif
@@ -81,16 +117,26 @@ void xsltInitOptions(xsltOptionsPtr ops);
 
 void xsltInitLibXml(xsltOptionsPtr ops);
 
+void xsltInitParams(xsltParamsPtr params);
+
+int xsltAddParam(xsltParamsPtr params, const xmlChar *name, int len,
+                 const xmlChar *value, int xpath);
+
+int xsltHasParam(xsltParamsPtr params, int count, const xmlChar *name,
+                 int len);
+
+void xsltFreeParams(xsltParamsPtr params);
+
 void xsltProcess(xsltOptionsPtr ops, xmlDocPtr doc,
-                 const char **params, xsltStylesheetPtr cur,
-                 const char *filename);
+                 xsltParamsPtr params, xsltStylesheetPtr cur,
+                 const char *filename, int number);
 
 xmlDocPtr xsltTransform(xsltOptionsPtr ops, xmlDocPtr doc,
-                 const char **params, xsltStylesheetPtr cur,
+                 xsltParamsPtr params, xsltStylesheetPtr cur,
                  const char *filename);
 
 int xsltRun(xsltOptionsPtr ops, char* xsl,
-            const char **params,
+            xsltParamsPtr params,
             int count, char **docs);
 
 #endif /* __TRANS_H */
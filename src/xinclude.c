@@ -0,0 +1,354 @@
+/*
+
+XMLStarlet: Command Line Toolkit to query/edit/check/transform XML documents
+
+Copyright (c) 2002-2004 Mikhail Grushinskiy.  All Rights Reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+
+#include <config.h>
+
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <libxml/xmlmemory.h>
+#include <libxml/hash.h>
+#include <libxml/parser.h>
+#include <libxml/threads.h>
+#include <libxml/uri.h>
+#include <libxml/xinclude.h>
+
+#include "jobs.h"
+#include "xinclude.h"
+
+#ifdef LIBXML_XINCLUDE_ENABLED
+
+/* a parsed version of an included document, shared by its users */
+typedef struct _xincludeDoc {
+    xmlDocPtr doc;
+    int refs;
+} xincludeDoc;
+
+typedef struct _xincludeEntry {
+    char *path;               /* NULL if not a local file */
+    time_t mtime;
+    long size;
+    int loaded;               /* parsed at least once */
+    int loading;              /* being parsed, by this thread (an include
+                                 loop) or another one */
+    xincludeDoc *cur;         /* NULL if it could not be loaded */
+} xincludeEntry;
+
+static xmlHashTablePtr cache = NULL;
+static xmlRMutexPtr cacheLock = NULL;
+
+#define XINCLUDE_PARSE_OPTIONS \
+    (XML_PARSE_NOENT | XML_PARSE_DTDLOAD | XML_PARSE_NOERROR | XML_PARSE_NOWARNING)
+
+static int xincludeTree(xmlDocPtr doc, xmlNodePtr node);
+
+static void
+xincludeRelease(xincludeDoc *version)
+{
+    if (version && --version->refs == 0)
+    {
+        xmlFreeDoc(version->doc);
+        xmlFree(version);
+    }
+}
+
+static void
+xincludeFreeEntry(void *payload, const xmlChar *name)
+{
+    xincludeEntry *entry = payload;
+
+    xincludeRelease(entry->cur);
+    xmlFree(entry->path);
+    xmlFree(entry);
+}
+
+/**
+ *  Check whether the file of @entry changed since it was parsed
+ */
+static int
+xincludeStale(xincludeEntry *entry)
+{
+#if HAVE_STAT
+    struct stat st;
+
+    if (entry->path == NULL) return 0;
+    if (stat(entry->path, &st) != 0)
+    {
+        st.st_mtime = (time_t) -1;
+        st.st_size = 0;
+    }
+    if (st.st_mtime != entry->mtime || (long) st.st_size != entry->size)
+    {
+        entry->mtime = st.st_mtime;
+        entry->size = (long) st.st_size;
+        return 1;
+    }
+#endif
+    return 0;
+}
+
+/**
+ *  Get the parsed document at @url, with its own includes processed,
+ *  or NULL; it must be given back with xincludeRelease() (under the lock).
+ *  The document is parsed without holding the lock: the entry is marked
+ *  as loading meanwhile, and those who ask for it then get NULL and
+ *  leave the include to libxml2.
+ */
+static xincludeDoc *
+xincludeLoad(const xmlChar *url)
+{
+    xincludeEntry *entry;
+    xincludeDoc *version = NULL;
+
+    xmlRMutexLock(cacheLock);
+    entry = xmlHashLookup(cache, url);
+    if (entry == NULL)
+    {
+        entry = xmlMalloc(sizeof(*entry));
+        memset(entry, 0, sizeof(*entry));
+        entry->path = localPath(url);
+        entry->mtime = (time_t) -1;
+        xmlHashAddEntry(cache, url, entry);
+    }
+
+    if (!entry->loading && (xincludeStale(entry) || !entry->loaded))
+    {
+        xmlDocPtr doc = NULL;
+        int exists = 1;
+
+        xincludeRelease(entry->cur);
+        entry->cur = NULL;
+        entry->loaded = 1;
+        entry->loading = 1;
+#if HAVE_STAT
+        exists = entry->path == NULL || entry->mtime != (time_t) -1;
+#endif
+        xmlRMutexUnlock(cacheLock);
+
+        /* missing or broken documents are left to libxml2, which
+         * reports them and uses the fallback */
+        if (exists)
+            doc = xmlReadFile((const char *) url, NULL,
+                              XINCLUDE_PARSE_OPTIONS);
+        /* documents with includes that need libxml2 are left to it */
+        if (doc && xincludeTree(doc, doc->children))
+        {
+            xmlFreeDoc(doc);
+            doc = NULL;
+        }
+
+        xmlRMutexLock(cacheLock);
+        entry->loading = 0;
+
+        if (doc)
+        {
+            entry->cur = xmlMalloc(sizeof(*entry->cur));
+            entry->cur->doc = doc;
+            entry->cur->refs = 1;
+        }
+    }
+
+    if (!entry->loading && entry->cur)
+    {
+        version = entry->cur;
+        version->refs++;
+    }
+    xmlRMutexUnlock(cacheLock);
+
+    return version;
+}
+
+/**
+ *  Adjust the xml:base of an included top level element the way
+ *  libxml2's XInclude does
+ */
+static void
+xincludeFixBase(xmlNodePtr node, const xmlChar *base)
+{
+    xmlChar *xmlBase = xmlGetNsProp(node, BAD_CAST "base", XML_XML_NAMESPACE);
+
+    if (xmlBase == NULL)
+        xmlNodeSetBase(node, base);
+    else
+    {
+        xmlChar *relBase = xmlBuildURI(xmlBase, base);
+        if (relBase != NULL)
+        {
+            xmlNodeSetBase(node, relBase);
+            xmlFree(relBase);
+        }
+        xmlFree(xmlBase);
+    }
+}
+
+/**
+ *  Replace include element @inc by a copy of the document it refers
+ *  to, if it is an include of a whole XML document; returns 1 if done
+ */
+static int
+xincludeCopy(xmlDocPtr doc, xmlNodePtr inc)
+{
+    xmlChar *href, *parse, *xpointer, *base, *url = NULL, *fixBase;
+    xincludeDoc *version = NULL;
+    xmlNodePtr child;
+    int done = 0;
+
+    href = xmlGetProp(inc, XINCLUDE_HREF);
+    parse = xmlGetProp(inc, XINCLUDE_PARSE);
+    xpointer = xmlGetProp(inc, XINCLUDE_PARSE_XPOINTER);
+    if (href == NULL || *href == 0 || xpointer != NULL ||
+        (parse != NULL && !xmlStrEqual(parse, XINCLUDE_PARSE_XML)) ||
+        inc->parent == NULL || inc->parent->type != XML_ELEMENT_NODE)
+        goto out;
+
+    base = xmlNodeGetBase(doc, inc);
+    if (base != NULL)
+    {
+        xmlChar *escBase = xmlURIEscape(base);
+        xmlChar *escHref = xmlURIEscape(href);
+        url = xmlBuildURI(escHref, escBase);
+        xmlFree(escBase);
+        xmlFree(escHref);
+        xmlFree(base);
+    }
+    else
+        url = xmlBuildURI(href, doc->URL);
+    if (url == NULL) goto out;
+
+    version = xincludeLoad(url);
+    if (version == NULL) goto out;
+
+    /* the base is only adjusted if the include has one, or the URL is
+     * relative to that of the including document */
+    fixBase = xmlGetNsProp(inc, BAD_CAST "base", XML_XML_NAMESPACE);
+    if (fixBase == NULL && doc->URL != NULL)
+    {
+        fixBase = xmlBuildRelativeURI(url, doc->URL);
+        if (fixBase != NULL && !xmlStrchr(fixBase, '/'))
+        {
+            xmlFree(fixBase);
+            fixBase = NULL;
+        }
+    }
+
+    for (child = version->doc->children; child; child = child->next)
+    {
+        xmlNodePtr copy;
+
+        if (child->type == XML_DTD_NODE ||
+            child->type == XML_XINCLUDE_START ||
+            child->type == XML_XINCLUDE_END)
+            continue;
+        copy = xmlDocCopyNode(child, doc, 1);
+        if (copy == NULL) continue;
+        if (fixBase != NULL && copy->type == XML_ELEMENT_NODE)
+            xincludeFixBase(copy, fixBase);
+        xmlAddPrevSibling(inc, copy);
+    }
+    xmlFree(fixBase);
+
+    xmlRMutexLock(cacheLock);
+    xincludeRelease(version);
+    xmlRMutexUnlock(cacheLock);
+
+    xmlUnlinkNode(inc);
+    xmlFreeNode(inc);
+    done = 1;
+
+out:
+    xmlFree(url);
+    xmlFree(href);
+    xmlFree(parse);
+    xmlFree(xpointer);
+    return done;
+}
+
+static int
+xincludeIsInclude(xmlNodePtr node)
+{
+    return node->type == XML_ELEMENT_NODE && node->ns != NULL &&
+        xmlStrEqual(node->name, XINCLUDE_NODE) &&
+        (xmlStrEqual(node->ns->href, XINCLUDE_NS) ||
+         xmlStrEqual(node->ns->href, XINCLUDE_OLD_NS));
+}
+
+/**
+ *  Replace the includes below @node that can come from the cache
+ */
+static int
+xincludeTree(xmlDocPtr doc, xmlNodePtr node)
+{
+    int left = 0;
+
+    while (node != NULL)
+    {
+        xmlNodePtr next = node->next;
+
+        if (xincludeIsInclude(node))
+        {
+            /* copies of cached documents have no includes left */
+            if (!xincludeCopy(doc, node)) left = 1;
+        }
+        else if (node->type == XML_ELEMENT_NODE)
+            left |= xincludeTree(doc, node->children);
+        node = next;
+    }
+    return left;
+}
+
+void
+xincludeCacheInit(void)
+{
+    if (cache == NULL)
+    {
+        cache = xmlHashCreate(16);
+        cacheLock = xmlNewRMutex();
+    }
+}
+
+/**
+ *  Do XInclude processing on @doc, returns -1 on errors
+ */
+int
+xincludeProcess(xmlDocPtr doc)
+{
+    if (cache == NULL) xincludeCacheInit();
+    if (!xincludeTree(doc, doc->children)) return 0;
+    return xmlXIncludeProcess(doc) < 0? -1 : 0;
+}
+
+void
+xincludeCacheFree(void)
+{
+    xmlHashFree(cache, xincludeFreeEntry);
+    xmlFreeRMutex(cacheLock);
+    cache = NULL;
+    cacheLock = NULL;
+}
+
+#endif  /* LIBXML_XINCLUDE_ENABLED */
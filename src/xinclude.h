@@ -0,0 +1,50 @@
+#ifndef __XINCLUDE_H
+#define __XINCLUDE_H
+
+/*
+
+XMLStarlet: Command Line Toolkit to query/edit/check/transform XML documents
+
+Copyright (c) 2002-2004 Mikhail Grushinskiy.  All Rights Reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+
+#include <libxml/tree.h>
+
+/*
+ *  XInclude processing with a cache of the included documents.
+ *
+ *  Includes of whole XML documents (no xpointer, parse="xml") are
+ *  resolved from a cache of parsed documents, keyed by URI and checked
+ *  against the file's modification time, and copied into place.  All
+ *  other includes, and those whose target cannot be loaded (so that
+ *  their fallback applies), are left to xmlXIncludeProcess().  The
+ *  cache may be used from several threads at once.
+ */
+
+void xincludeCacheInit(void);
+
+int xincludeProcess(xmlDocPtr doc);
+
+void xincludeCacheFree(void);
+
+#endif /* __XINCLUDE_H */
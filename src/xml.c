@@ -59,6 +59,7 @@ extern int trMain(int argc, char **argv);
 extern int valMain(int argc, char **argv);
 extern int foMain(int argc, char **argv);
 extern int elMain(int argc, char **argv);
+extern int inferMain(int argc, char **argv);
 extern int c14nMain(int argc, char **argv);
 extern int lsMain(int argc, char **argv);
 extern int pyxMain(int argc, char **argv);
@@ -359,6 +360,10 @@ main(int argc, char **argv)
     {
         ret = elMain(argc, argv);
     }
+    else if (!strcmp(argv[1], "infer") || !strcmp(argv[1], "schema"))
+    {
+        ret = inferMain(argc, argv);
+    }
     else if (!strcmp(argv[1], "c14n") || !strcmp(argv[1], "canonic"))
     {
         ret = c14nMain(argc, argv);
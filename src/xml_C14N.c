@@ -24,10 +24,20 @@
 #include <libxml/parser.h>
 #include <libxml/xpath.h>
 #include <libxml/xpathInternals.h>
+#include <libxml/parserInternals.h>
+#include <libxml/uri.h>
 
 #include <libxml/c14n.h>
 
+#ifdef LIBXML_READER_ENABLED
+#define C14N_STREAM
+#include <libxml/xmlreader.h>
+#endif
+
 #include "xmlstar.h"
+#include "escape.h"
+#include "digest.h"
+#include "jobs.h"
 
 static void c14nUsage(const char *name, exit_status status)
 {
@@ -39,8 +49,45 @@ static void c14nUsage(const char *name, exit_status status)
     exit(status);
 }
 
-static xmlXPathObjectPtr
-load_xpath_expr (xmlDocPtr parent_doc, const char* filename);
+/*
+ * XPath subset of the documents, compiled once for all of them
+ */
+typedef struct _c14n_subset {
+    xmlXPathCompExprPtr expr;
+    xmlChar **namespaces;       /* prefix and href pairs */
+    int ns_nr;                  /* number of pairs */
+    /* (//. | //@* | //namespace::*)[ancestor-or-self::name] is done
+       with a visibility callback instead of a node set */
+    xmlChar *subtree_name;
+    xmlChar *subtree_href;      /* namespace of subtree_name or NULL */
+} c14n_subset;
+
+typedef struct _c14n_options {
+    int with_comments;
+    int exclusive;
+    xmlChar **inclusive_namespaces;
+    c14n_subset *subset;
+    int nonet;
+    int stream;                 /* canonicalize without a tree */
+    int digest;                 /* digestAlgorithm, -1 to print the output */
+    int names;                  /* print file names after the digests */
+    int jobs;
+    const char *files_from;
+} c14n_options;
+
+typedef struct _c14n_job {
+    c14n_options *ops;
+    char **files;
+    int status;
+} c14n_job;
+
+static void add_xpath_ns (c14n_subset *subset, const xmlChar *prefix,
+                          const xmlChar *href);
+static xmlChar *load_xpath_expr (c14n_subset *subset, const char* filename);
+static int compile_xpath_expr (c14n_subset *subset, const xmlChar *expr);
+static void free_xpath_expr (c14n_subset *subset);
+static xmlXPathObjectPtr eval_xpath_expr (xmlDocPtr doc, c14n_subset *subset);
+static int subtree_visible (void *user_data, xmlNodePtr node, xmlNodePtr parent);
 
 static xmlChar **parse_list(xmlChar *str);
 
@@ -48,14 +95,375 @@ static xmlChar **parse_list(xmlChar *str);
 static void print_xpath_nodes(xmlNodeSetPtr nodes);
 #endif
 
+#ifdef C14N_STREAM
+
+/*
+ * Position of the current node relative to the document element
+ */
+typedef enum {
+    C14N_BEFORE_ROOT,
+    C14N_IN_ROOT,
+    C14N_AFTER_ROOT
+} c14n_position;
+
+/*
+ * A namespace declaration rendered on one of the open elements
+ */
+typedef struct _c14n_ns {
+    const xmlChar *prefix;      /* "" for the default namespace */
+    const xmlChar *href;
+    int depth;
+} c14n_ns;
+
+typedef struct _c14n_stream {
+    xmlOutputBufferPtr out;
+    int with_comments;
+    int exclusive;
+    xmlChar **inclusive_namespaces;
+    c14n_position pos;
+    c14n_ns *rendered;          /* stack, innermost declarations last */
+    int rendered_nr;
+    int rendered_size;
+    xmlAttrPtr *attrs;          /* attributes of the current start tag */
+    int attrs_size;
+    xmlBufferPtr scratch;
+} c14n_stream;
+
+static void
+c14n_write_normalized(c14n_stream *st, const xmlChar *str,
+                      xml_C14NNormalizationMode mode) {
+    xmlChar *buffer;
+
+    buffer = xml_C11NNormalizeString(str, mode);
+    if(buffer != NULL) {
+        xmlOutputBufferWriteString(st->out, (const char *) buffer);
+        xmlFree(buffer);
+    }
+}
+
+static int
+c14n_is_xml_ns(xmlNsPtr ns) {
+    return (ns != NULL) && xmlStrEqual(ns->prefix, BAD_CAST "xml") &&
+        xmlStrEqual(ns->href, XML_XML_NAMESPACE);
+}
+
+/*
+ * Render namespace @ns on the element at @depth unless the nearest
+ * output ancestor already did with the same value; xmlns="" is only
+ * rendered to undo a non-empty default namespace
+ */
+static void
+c14n_render_ns(c14n_stream *st, xmlNsPtr ns, int depth) {
+    const xmlChar *prefix, *href, *cur = NULL;
+    int i;
+
+    if(ns == NULL || c14n_is_xml_ns(ns)) return;
+    prefix = (ns->prefix != NULL) ? ns->prefix : BAD_CAST "";
+    href = (ns->href != NULL) ? ns->href : BAD_CAST "";
+
+    for(i = st->rendered_nr - 1; i >= 0; --i) {
+        if(xmlStrEqual(st->rendered[i].prefix, prefix)) {
+            cur = st->rendered[i].href;
+            break;
+        }
+    }
+    if((cur != NULL) ? xmlStrEqual(cur, href) : (*href == '\0')) return;
+
+    if(st->rendered_nr == st->rendered_size) {
+        st->rendered_size = st->rendered_size ? st->rendered_size * 2 : 16;
+        st->rendered = xmlRealloc(st->rendered,
+            st->rendered_size * sizeof(*st->rendered));
+        if(st->rendered == NULL) {
+            fprintf(stderr, "out of memory\n");
+            exit(EXIT_INTERNAL_ERROR);
+        }
+    }
+    st->rendered[st->rendered_nr].prefix = prefix;
+    st->rendered[st->rendered_nr].href = href;
+    st->rendered[st->rendered_nr].depth = depth;
+    st->rendered_nr++;
+}
+
+static int
+c14n_ns_compare(const void *a, const void *b) {
+    return xmlStrcmp(((const c14n_ns *) a)->prefix,
+                     ((const c14n_ns *) b)->prefix);
+}
+
+/*
+ * Attributes without a namespace come first, the others are sorted
+ * by namespace URI, then all by local name
+ */
+static int
+c14n_attr_compare(const void *a, const void *b) {
+    xmlAttrPtr attr1 = *(const xmlAttrPtr *) a;
+    xmlAttrPtr attr2 = *(const xmlAttrPtr *) b;
+    int ret;
+
+    if(attr1->ns == attr2->ns) return xmlStrcmp(attr1->name, attr2->name);
+    if(attr1->ns == NULL) return -1;
+    if(attr2->ns == NULL) return 1;
+    ret = xmlStrcmp(attr1->ns->href, attr2->ns->href);
+    return (ret != 0) ? ret : xmlStrcmp(attr1->name, attr2->name);
+}
+
+static void
+c14n_write_qname(c14n_stream *st, xmlNsPtr ns, const xmlChar *name) {
+    if((ns != NULL) && (xmlStrlen(ns->prefix) > 0)) {
+        xmlOutputBufferWriteString(st->out, (const char *) ns->prefix);
+        xmlOutputBufferWrite(st->out, 1, ":");
+    }
+    xmlOutputBufferWriteString(st->out, (const char *) name);
+}
+
+/*
+ * Canonical XML does not allow relative namespace URIs
+ */
+static int
+c14n_check_relative_ns(xmlNodePtr cur) {
+    xmlNsPtr ns;
+
+    for(ns = cur->nsDef; ns != NULL; ns = ns->next) {
+        xmlURIPtr uri;
+        int relative;
+
+        if(xmlStrlen(ns->href) == 0) continue;
+        uri = xmlParseURI((const char *) ns->href);
+        if(uri == NULL) {
+            fprintf(stderr, "Error: unable to parse namespace URI \"%s\"\n",
+                ns->href);
+            return(-1);
+        }
+        relative = (uri->scheme == NULL);
+        xmlFreeURI(uri);
+        if(relative) {
+            fprintf(stderr, "Error: relative namespace URI \"%s\" is invalid here\n",
+                ns->href);
+            return(-1);
+        }
+    }
+    return(0);
+}
+
+static int
+c14n_start_element(c14n_stream *st, xmlNodePtr cur, int depth) {
+    xmlAttrPtr attr;
+    xmlNsPtr ns;
+    int first = st->rendered_nr, nattrs = 0, i;
+
+    if(c14n_check_relative_ns(cur) < 0) return(-1);
+
+    /*
+     * Namespace axis: inclusive canonicalization renders what is
+     * declared here, exclusive one what the element and its attributes
+     * visibly use plus the prefixes from the inclusive list
+     */
+    if(!st->exclusive) {
+        for(ns = cur->nsDef; ns != NULL; ns = ns->next)
+            c14n_render_ns(st, ns, depth);
+    } else {
+        if(st->inclusive_namespaces != NULL) {
+            for(i = 0; st->inclusive_namespaces[i] != NULL; ++i) {
+                const xmlChar *prefix = st->inclusive_namespaces[i];
+                if(xmlStrEqual(prefix, BAD_CAST "#default") || *prefix == '\0')
+                    prefix = NULL;
+                c14n_render_ns(st, xmlSearchNs(cur->doc, cur, prefix), depth);
+            }
+        }
+        c14n_render_ns(st, (cur->ns != NULL) ? cur->ns :
+                       xmlSearchNs(cur->doc, cur, NULL), depth);
+        for(attr = cur->properties; attr != NULL; attr = attr->next)
+            c14n_render_ns(st, attr->ns, depth);
+    }
+
+    for(attr = cur->properties; attr != NULL; attr = attr->next) {
+        if(nattrs == st->attrs_size) {
+            st->attrs_size = st->attrs_size ? st->attrs_size * 2 : 16;
+            st->attrs = xmlRealloc(st->attrs,
+                st->attrs_size * sizeof(*st->attrs));
+            if(st->attrs == NULL) {
+            fprintf(stderr, "out of memory\n");
+            exit(EXIT_INTERNAL_ERROR);
+        }
+        }
+        st->attrs[nattrs++] = attr;
+    }
+
+    xmlOutputBufferWrite(st->out, 1, "<");
+    c14n_write_qname(st, cur->ns, cur->name);
+
+    if (st->rendered_nr - first > 1)
+        qsort(st->rendered + first, st->rendered_nr - first,
+              sizeof(*st->rendered), c14n_ns_compare);
+    for(i = first; i < st->rendered_nr; ++i) {
+        xmlOutputBufferWrite(st->out, 6, " xmlns");
+        if(*st->rendered[i].prefix != '\0') {
+            xmlOutputBufferWrite(st->out, 1, ":");
+            xmlOutputBufferWriteString(st->out,
+                (const char *) st->rendered[i].prefix);
+        }
+        xmlOutputBufferWrite(st->out, 1, "=");
+        xmlBufferEmpty(st->scratch);
+        xmlBufferWriteQuotedString(st->scratch, st->rendered[i].href);
+        xmlOutputBufferWrite(st->out, xmlBufferLength(st->scratch),
+                             (const char *) xmlBufferContent(st->scratch));
+    }
+
+    if (nattrs > 1)
+        qsort(st->attrs, nattrs, sizeof(*st->attrs), c14n_attr_compare);
+    for(i = 0; i < nattrs; ++i) {
+        xmlChar *value;
+
+        attr = st->attrs[i];
+        xmlOutputBufferWrite(st->out, 1, " ");
+        c14n_write_qname(st, attr->ns, attr->name);
+        xmlOutputBufferWrite(st->out, 2, "=\"");
+        value = xmlNodeListGetString(cur->doc, attr->children, 1);
+        if(value != NULL) {
+            c14n_write_normalized(st, value, XML_C14N_NORMALIZE_ATTR);
+            xmlFree(value);
+        }
+        xmlOutputBufferWrite(st->out, 1, "\"");
+    }
+    xmlOutputBufferWrite(st->out, 1, ">");
+
+    if(depth == 0) st->pos = C14N_IN_ROOT;
+    return(0);
+}
+
+static void
+c14n_end_element(c14n_stream *st, xmlNodePtr cur, int depth) {
+    xmlOutputBufferWrite(st->out, 2, "</");
+    c14n_write_qname(st, cur->ns, cur->name);
+    xmlOutputBufferWrite(st->out, 1, ">");
+
+    while(st->rendered_nr > 0 &&
+          st->rendered[st->rendered_nr - 1].depth >= depth)
+        st->rendered_nr--;
+    if(depth == 0) st->pos = C14N_AFTER_ROOT;
+}
+
+/*
+ * Comments and PIs outside of the document element are separated
+ * from it by a newline
+ */
+static int
+c14n_stream_node(c14n_stream *st, xmlTextReaderPtr reader) {
+    xmlNodePtr cur = xmlTextReaderCurrentNode(reader);
+    int depth = xmlTextReaderDepth(reader);
+
+    switch(xmlTextReaderNodeType(reader)) {
+    case XML_READER_TYPE_ELEMENT:
+        if(c14n_start_element(st, cur, depth) < 0)
+            return(-1);
+        if(xmlTextReaderIsEmptyElement(reader))
+            c14n_end_element(st, cur, depth);
+        break;
+    case XML_READER_TYPE_END_ELEMENT:
+        c14n_end_element(st, cur, depth);
+        break;
+    case XML_READER_TYPE_TEXT:
+    case XML_READER_TYPE_CDATA:
+    case XML_READER_TYPE_WHITESPACE:
+    case XML_READER_TYPE_SIGNIFICANT_WHITESPACE:
+        c14n_write_normalized(st, cur->content, XML_C14N_NORMALIZE_TEXT);
+        break;
+    case XML_READER_TYPE_COMMENT:
+        if(!st->with_comments) break;
+        if(st->pos == C14N_AFTER_ROOT)
+            xmlOutputBufferWrite(st->out, 1, "\n");
+        xmlOutputBufferWrite(st->out, 4, "<!--");
+        c14n_write_normalized(st, cur->content, XML_C14N_NORMALIZE_COMMENT);
+        xmlOutputBufferWrite(st->out, 3, "-->");
+        if(st->pos == C14N_BEFORE_ROOT)
+            xmlOutputBufferWrite(st->out, 1, "\n");
+        break;
+    case XML_READER_TYPE_PROCESSING_INSTRUCTION:
+        if(st->pos == C14N_AFTER_ROOT)
+            xmlOutputBufferWrite(st->out, 1, "\n");
+        xmlOutputBufferWrite(st->out, 2, "<?");
+        xmlOutputBufferWriteString(st->out, (const char *) cur->name);
+        if((cur->content != NULL) && (*cur->content != '\0')) {
+            xmlOutputBufferWrite(st->out, 1, " ");
+            c14n_write_normalized(st, cur->content, XML_C14N_NORMALIZE_PI);
+        }
+        xmlOutputBufferWrite(st->out, 2, "?>");
+        if(st->pos == C14N_BEFORE_ROOT)
+            xmlOutputBufferWrite(st->out, 1, "\n");
+        break;
+    default:
+        /* the DTD is not part of the canonical form */
+        break;
+    }
+    return(0);
+}
+
+/*
+ * Canonicalize the whole document to @out while it is being parsed:
+ * nodes are written as the xmlTextReader delivers them and freed
+ * afterwards, so only the open elements and their namespaces are kept
+ * in memory
+ */
+static int
+run_c14n_stream(c14n_options *ops, const char* xml_filename,
+                xmlOutputBufferPtr out) {
+    xmlTextReaderPtr reader;
+    c14n_stream st;
+    int ret, status = EXIT_SUCCESS;
+
+    reader = xmlReaderForFile(xml_filename, NULL,
+        XML_PARSE_NOENT | XML_PARSE_DTDLOAD |
+        XML_PARSE_DTDATTR | (ops->nonet? XML_PARSE_NONET:0));
+    if (reader == NULL) {
+        fprintf(stderr, "Error: unable to parse file \"%s\"\n", xml_filename);
+        return(EXIT_BAD_FILE);
+    }
+
+    memset(&st, 0, sizeof(st));
+    st.out = out;
+    st.with_comments = ops->with_comments;
+    st.exclusive = ops->exclusive;
+    st.inclusive_namespaces = ops->inclusive_namespaces;
+    st.pos = C14N_BEFORE_ROOT;
+    st.scratch = xmlBufferCreate();
+
+    while((ret = xmlTextReaderRead(reader)) == 1) {
+        if(c14n_stream_node(&st, reader) < 0)
+            break;
+    }
+
+    if(ret == 1) {
+        fprintf(stderr,"Error: failed to canonicalize XML file \"%s\"\n",
+            xml_filename);
+        status = EXIT_FAILURE;
+    } else if(ret != 0) {
+        fprintf(stderr, "Error: unable to parse file \"%s\"\n", xml_filename);
+        status = EXIT_BAD_FILE;
+    } else if(st.pos != C14N_AFTER_ROOT) {
+        fprintf(stderr,"Error: empty document for file \"%s\"\n", xml_filename);
+        status = EXIT_BAD_FILE;
+    }
+
+    xmlFree(st.rendered);
+    xmlFree(st.attrs);
+    xmlBufferFree(st.scratch);
+    xmlFreeTextReader(reader);
+    return(status);
+}
+
+#endif /* C14N_STREAM */
+
 static int 
-run_c14n(const char* xml_filename, int with_comments, int exclusive,
-         const char* xpath_filename, xmlChar **inclusive_namespaces,
-         int nonet) {
+run_c14n(c14n_options *ops, const char* xml_filename, xmlOutputBufferPtr out) {
     xmlDocPtr doc;
     xmlXPathObjectPtr xpath = NULL; 
     int ret;
 
+#ifdef C14N_STREAM
+    if (ops->stream)
+        return run_c14n_stream(ops, xml_filename, out);
+#endif
+
     /*
      * build an XML tree from a the file; we need to add default
      * attributes and resolve all character and entities references
@@ -63,7 +471,7 @@ run_c14n(const char* xml_filename, int with_comments, int exclusive,
 
     doc = readXml(xml_filename,
         XML_PARSE_NOENT | XML_PARSE_DTDLOAD |
-        XML_PARSE_DTDATTR | (nonet? XML_PARSE_NONET:0));
+        XML_PARSE_DTDATTR | (ops->nonet? XML_PARSE_NONET:0));
     if (doc == NULL) {
         fprintf(stderr, "Error: unable to parse file \"%s\"\n", xml_filename);
         return(EXIT_BAD_FILE);
@@ -79,10 +487,21 @@ run_c14n(const char* xml_filename, int with_comments, int exclusive,
     }
 
     /* 
-     * load xpath file if specified 
+     * evaluate the xpath subset if specified 
      */
-    if(xpath_filename) {
-        xpath = load_xpath_expr(doc, xpath_filename);
+    if(ops->subset && ops->subset->subtree_name) {
+        ret = xmlC14NExecute(doc, subtree_visible, ops->subset,
+            ops->exclusive, ops->inclusive_namespaces,
+            ops->with_comments, out);
+        xmlFreeDoc(doc);
+        if(ret < 0) {
+            fprintf(stderr,"Error: failed to canonicalize XML file \"%s\" (ret=%d)\n",
+                xml_filename, ret);
+            return(EXIT_FAILURE);
+        }
+        return(EXIT_SUCCESS);
+    } else if(ops->subset) {
+        xpath = eval_xpath_expr(doc, ops->subset);
         if(xpath == NULL) {
             fprintf(stderr,"Error: unable to evaluate xpath expression\n");
             xmlFreeDoc(doc); 
@@ -93,14 +512,14 @@ run_c14n(const char* xml_filename, int with_comments, int exclusive,
     /*
      * Canonical form
      */
-    set_stdout_binary();       /* avoid line ending conversion */
-    ret = xmlC14NDocSave(doc,
+    ret = xmlC14NDocSaveTo(doc,
         (xpath) ? xpath->nodesetval : NULL,
-        exclusive, inclusive_namespaces,
-        with_comments, "-", 0);
+        ops->exclusive, ops->inclusive_namespaces,
+        ops->with_comments, out);
     if(ret < 0) {
         fprintf(stderr,"Error: failed to canonicalize XML file \"%s\" (ret=%d)\n",
             xml_filename, ret);
+        if(xpath != NULL) xmlXPathFreeObject(xpath);
         xmlFreeDoc(doc);
         return(EXIT_FAILURE);
     }
@@ -114,51 +533,257 @@ run_c14n(const char* xml_filename, int with_comments, int exclusive,
     return(ret >= 0? EXIT_SUCCESS : EXIT_FAILURE);
 }
 
+/*
+ * Canonicalize one file to @out (NULL for stdout), or print its digest
+ */
+static int
+c14n_file(c14n_options *ops, const char* xml_filename, xmlBufferPtr out) {
+    digestContext digest_ctx;
+    xmlOutputBufferPtr buf;
+    int ret;
+
+    if(ops->digest >= 0) {
+        digestInit(&digest_ctx, ops->digest);
+        buf = digestOutputBuffer(&digest_ctx);
+    } else if(out != NULL) {
+        buf = jobOutputBuffer(out, NULL);
+    } else {
+        buf = xmlOutputBufferCreateFile(stdout, NULL);
+    }
+
+    ret = run_c14n(ops, xml_filename, buf);
+    if(xmlOutputBufferClose(buf) < 0 && ret == EXIT_SUCCESS) {
+        fprintf(stderr, "Error: failed to write canonical XML of \"%s\"\n",
+            xml_filename);
+        ret = EXIT_FAILURE;
+    }
+
+    /* "<digest>  <file>" lines, laid out like sha256sum's but digests of
+       the canonical form, not of the file */
+    if(ops->digest >= 0 && ret == EXIT_SUCCESS) {
+        unsigned char md[DIGEST_MAX_SIZE];
+        char hex[2 * DIGEST_MAX_SIZE + 1];
+
+        digestHex(md, digestFinal(&digest_ctx, md), hex);
+        if(out == NULL) {
+            if(ops->names)
+                printf("%s  %s\n", hex, xml_filename);
+            else
+                printf("%s\n", hex);
+        } else {
+            xmlBufferCCat(out, hex);
+            if(ops->names) {
+                xmlBufferCCat(out, "  ");
+                xmlBufferCCat(out, xml_filename);
+            }
+            xmlBufferCCat(out, "\n");
+        }
+    }
+    return(ret);
+}
+
+static int
+c14n_run_file(void *shared, void *local, int item, xmlBufferPtr out) {
+    c14n_job *job = shared;
+    return c14n_file(job->ops, job->files[item], out);
+}
+
+static void
+c14n_done_file(void *shared, int item, int status, xmlBufferPtr out) {
+    c14n_job *job = shared;
+
+    if(out)
+        fwrite(xmlBufferContent(out), 1, xmlBufferLength(out), stdout);
+    if(status) job->status = status;
+}
+
+/*
+ * Canonicalize the files named in @listname, one after the other
+ */
+static void
+c14n_files_from(c14n_job *job, const char *listname) {
+    FILE *list = stdin;
+    char *line = NULL;
+    size_t size = 0;
+    int status;
+
+    if(strcmp(listname, "-")) {
+        list = fopen(listname, "r");
+        if(list == NULL) {
+            fprintf(stderr, "Error: could not open: %s\n", listname);
+            job->status = EXIT_BAD_FILE;
+            return;
+        }
+    }
+
+    while(readListLine(list, &line, &size)) {
+        status = c14n_file(job->ops, line, NULL);
+        if(status) job->status = status;
+        fflush(stdout);
+    }
+    xmlFree(line);
+
+    if(list != stdin) fclose(list);
+}
+
+static const char *
+c14n_option_arg(int argc, char **argv, int i) {
+    if(i + 1 >= argc) {
+        fprintf(stderr, "error: %s needs an argument\n", argv[i]);
+        c14nUsage(argv[0], EXIT_BAD_ARGS);
+    }
+    return argv[i + 1];
+}
+
 int c14nMain(int argc, char **argv) {
-    int ret = -1, nonet = 1;
+    static const jobHandlers c14n_handlers =
+        { NULL, c14n_run_file, c14n_done_file, NULL };
+    static char *stdin_files[] = { "-" };
+    c14n_options ops;
+    c14n_job job;
+    c14n_subset subset;
+    const char *xpath_filename = NULL;
+    const char *xpath_expr = NULL;
+    char *ns_list = NULL;
+    int i, nfiles, many = 0;
     
     /*
-     * Parse command line and process file
+     * Parse command line
      */
+    memset(&ops, 0, sizeof(ops));
+    memset(&subset, 0, sizeof(subset));
+    ops.with_comments = 1;
+    ops.nonet = 1;
+    ops.digest = -1;
+    ops.jobs = 1;
+
+    for (i = 2; i < argc && argv[i][0] == '-' && argv[i][1] != '\0'; i++) {
+        if (strcmp(argv[i], "--net") == 0) {
+            ops.nonet = 0;
+        } else if (strcmp(argv[i], "--stream") == 0) {
+            ops.stream = 1;
+        } else if (strcmp(argv[i], "--digest") == 0) {
+            ops.digest = digestAlgorithmByName(c14n_option_arg(argc, argv, i++));
+            if (ops.digest < 0) {
+                fprintf(stderr, "error: --digest needs sha256 or sha1\n");
+                c14nUsage(argv[0], EXIT_BAD_ARGS);
+            }
+        } else if (strcmp(argv[i], "--xpath-file") == 0) {
+            xpath_filename = c14n_option_arg(argc, argv, i++);
+            many = 1;
+        } else if (strcmp(argv[i], "--xpath") == 0) {
+            xpath_expr = c14n_option_arg(argc, argv, i++);
+            many = 1;
+        } else if (strcmp(argv[i], "-N") == 0) {
+            const char *arg = c14n_option_arg(argc, argv, i++);
+            const char *equal_sign = strchr(arg, '=');
+            xmlChar *prefix;
 
-    if (argc > 2 && strcmp(argv[2], "--net") == 0) {
-        nonet = 0;
-        /* TODO: parse options properly */
-        argc--;
-        argv++;
+            if (equal_sign == NULL) {
+                fprintf(stderr, "error: namespace should have the form <prefix>=<url>\n");
+                c14nUsage(argv[0], EXIT_BAD_ARGS);
+            }
+            prefix = xmlStrndup(BAD_CAST arg, equal_sign - arg);
+            add_xpath_ns(&subset, prefix, BAD_CAST equal_sign + 1);
+            xmlFree(prefix);
+        } else if (strcmp(argv[i], "--inclusive-ns") == 0) {
+            ns_list = (char *) c14n_option_arg(argc, argv, i++);
+            many = 1;
+        } else if (strcmp(argv[i], "-j") == 0 || strcmp(argv[i], "--jobs") == 0) {
+            ops.jobs = parseJobCount(c14n_option_arg(argc, argv, i++));
+            if (ops.jobs == 0) c14nUsage(argv[0], EXIT_BAD_ARGS);
+            many = 1;
+        } else if (strcmp(argv[i], "--files-from") == 0) {
+            ops.files_from = c14n_option_arg(argc, argv, i++);
+            many = 1;
+        } else if (strcmp(argv[i], "--with-comments") == 0) {
+            ops.with_comments = 1;
+            ops.exclusive = 0;
+        } else if (strcmp(argv[i], "--without-comments") == 0) {
+            ops.with_comments = 0;
+            ops.exclusive = 0;
+        } else if (strcmp(argv[i], "--exc-with-comments") == 0) {
+            ops.with_comments = 1;
+            ops.exclusive = 1;
+        } else if (strcmp(argv[i], "--exc-without-comments") == 0) {
+            ops.with_comments = 0;
+            ops.exclusive = 1;
+        } else if (strcmp(argv[i], "--help") == 0 || strcmp(argv[i], "-h") == 0) {
+            c14nUsage(argv[0], EXIT_SUCCESS);
+        } else {
+            fprintf(stderr, "error: bad arguments.\n");
+            c14nUsage(argv[0], EXIT_BAD_ARGS);
+        }
     }
 
-    if (argc < 4) {
-        if (argc >= 3)
-        {
-            if (strcmp(argv[2], "--help") == 0 || strcmp(argv[2], "-h") == 0)
-                c14nUsage(argv[0], EXIT_SUCCESS);
+    /*
+     * All the remaining arguments are input files, unless the old
+     * <xml-file> [<xpath-file>] [<inclusive-ns-list>] form is used
+     */
+    job.ops = &ops;
+    job.status = EXIT_SUCCESS;
+    job.files = argv + i;
+    nfiles = argc - i;
+    if (!many && nfiles > 1) {
+        if (nfiles > 3) {
+            fprintf(stderr, "error: bad arguments.\n");
+            c14nUsage(argv[0], EXIT_BAD_ARGS);
         }
-        ret = run_c14n((argc > 2)? argv[2] : "-", 1, 0, NULL, NULL, nonet);
-    } else if(strcmp(argv[2], "--with-comments") == 0) {
-        ret = run_c14n(argv[3], 1, 0, (argc > 4) ? argv[4] : NULL, NULL, nonet);
-    } else if(strcmp(argv[2], "--without-comments") == 0) {
-        ret = run_c14n(argv[3], 0, 0, (argc > 4) ? argv[4] : NULL, NULL, nonet);
-    } else if(strcmp(argv[2], "--exc-with-comments") == 0) {
-        xmlChar **list;
-        
-        /* load exclusive namespace from command line */
-        list = (argc > 5) ? parse_list((xmlChar *)argv[5]) : NULL;
-        ret = run_c14n(argv[3], 1, 1, (argc > 4) ? argv[4] : NULL, list, nonet);
-        if(list != NULL) xmlFree(list);
-    } else if(strcmp(argv[2], "--exc-without-comments") == 0) {
-        xmlChar **list;
-        
-        /* load exclusive namespace from command line */
-        list = (argc > 5) ? parse_list((xmlChar *)argv[5]) : NULL;
-        ret = run_c14n(argv[3], 0, 1, (argc > 4) ? argv[4] : NULL, list, nonet);
-        if(list != NULL) xmlFree(list);
-    } else {
-        fprintf(stderr, "error: bad arguments.\n");
+        xpath_filename = argv[i + 1];
+        if (nfiles > 2) ns_list = argv[i + 2];
+        nfiles = 1;
+    }
+    if (nfiles == 0 && !ops.files_from) {
+        job.files = stdin_files;
+        nfiles = 1;
+    }
+    ops.names = (nfiles > 1 || ops.files_from);
+
+    if (xpath_filename && xpath_expr) {
+        fprintf(stderr, "error: both an XPath file and --xpath given\n");
         c14nUsage(argv[0], EXIT_BAD_ARGS);
     }
+    if (ops.stream && (xpath_filename || xpath_expr)) {
+        fprintf(stderr, "Error: --stream can not be used with an XPath subset\n");
+        free_xpath_expr(&subset);
+        return(EXIT_BAD_ARGS);
+    }
+
+    /* 
+     * load and compile the xpath subset if specified, once for all the
+     * documents
+     */
+    if (xpath_filename || xpath_expr) {
+        xmlChar *expr = xpath_expr ? xmlStrdup(BAD_CAST xpath_expr) :
+            load_xpath_expr(&subset, xpath_filename);
+
+        if (expr == NULL || compile_xpath_expr(&subset, expr) < 0) {
+            fprintf(stderr,"Error: unable to evaluate xpath expression\n");
+            xmlFree(expr);
+            free_xpath_expr(&subset);
+            return(EXIT_BAD_FILE);
+        }
+        xmlFree(expr);
+        ops.subset = &subset;
+    }
+
+    /* load exclusive namespace from command line */
+    if (ns_list && ops.exclusive)
+        ops.inclusive_namespaces = parse_list((xmlChar *) ns_list);
+
+    /*
+     * Canonical forms go to stdout, or only their digests
+     */
+    if (ops.digest < 0)
+        set_stdout_binary();   /* avoid line ending conversion */
+    runJobs(ops.jobs, nfiles, &job, &c14n_handlers);
+    if (ops.files_from)
+        c14n_files_from(&job, ops.files_from);
 
-    return ret;
+    free_xpath_expr(&subset);
+    if (ops.inclusive_namespaces) xmlFree(ops.inclusive_namespaces);
+
+    return job.status;
 }
 
 /*
@@ -213,12 +838,27 @@ parse_list(xmlChar *str) {
     return buffer;
 }
 
-static xmlXPathObjectPtr
-load_xpath_expr (xmlDocPtr parent_doc, const char* filename) {
-    xmlXPathObjectPtr xpath; 
+static void
+add_xpath_ns (c14n_subset *subset, const xmlChar *prefix, const xmlChar *href) {
+    subset->namespaces = xmlRealloc(subset->namespaces,
+        2 * (subset->ns_nr + 1) * sizeof(xmlChar *));
+    if(subset->namespaces == NULL) {
+        fprintf(stderr, "out of memory\n");
+        exit(EXIT_INTERNAL_ERROR);
+    }
+    subset->namespaces[2 * subset->ns_nr] = xmlStrdup(prefix);
+    subset->namespaces[2 * subset->ns_nr + 1] = xmlStrdup(href);
+    subset->ns_nr++;
+}
+
+/*
+ * Read the XPath expression from the XPath element in @filename, its
+ * namespaces are added to @subset; the result must be freed with xmlFree()
+ */
+static xmlChar *
+load_xpath_expr (c14n_subset *subset, const char* filename) {
     xmlDocPtr doc;
     xmlChar *expr;
-    xmlXPathContextPtr ctx; 
     xmlNodePtr node;
     xmlNsPtr ns;
     
@@ -261,46 +901,146 @@ load_xpath_expr (xmlDocPtr parent_doc, const char* filename) {
         return(NULL);
     }
 
-    ctx = xmlXPathNewContext(parent_doc);
+    /*
+     * Keep the namespaces to register in every context
+     */
+    for(ns = node->nsDef; ns != NULL; ns = ns->next)
+        add_xpath_ns(subset, ns->prefix, ns->href);
+
+    xmlFreeDoc(doc); 
+    return(expr);
+}
+
+/*
+ * Compile @expr once for all documents; the usual subset of a whole
+ * element, (//. | //@* | //namespace::*)[ancestor-or-self::name], selects
+ * every node of the document into a node set for each of them, so it
+ * is recognized and done with a visibility callback instead
+ */
+static int
+compile_xpath_expr (c14n_subset *subset, const xmlChar *expr) {
+    /* the tokens before the name, there may be white space between them */
+    static const char *const subtree_tokens[] = {
+        "(", "//", ".", "|", "//", "@", "*", "|", "//", "namespace", "::", "*",
+        ")", "[", "ancestor-or-self", "::", NULL
+    };
+    const xmlChar *p = expr, *end;
+    xmlChar *name, *colon;
+    int i, len;
+
+    subset->expr = xmlXPathCompile(expr);
+    if(subset->expr == NULL) {
+        fprintf(stderr,"Error: unable to compile xpath expression\n");
+        return(-1);
+    }
+
+    for(i = 0; subtree_tokens[i] != NULL; i++) {
+        len = strlen(subtree_tokens[i]);
+        while(IS_BLANK_CH(*p)) p++;
+        if(xmlStrncmp(p, BAD_CAST subtree_tokens[i], len) != 0) return(0);
+        p += len;
+    }
+
+    /* the predicate has to be a single name, not "name or ..." */
+    while(IS_BLANK_CH(*p)) p++;
+    for(len = 0; p[len] != '\0' && p[len] != ']' && !IS_BLANK_CH(p[len]); len++)
+        ;
+    for(end = p + len; IS_BLANK_CH(*end); end++)
+        ;
+    if(*end != ']') return(0);
+    for(end++; IS_BLANK_CH(*end); end++)
+        ;
+    if(*end != '\0') return(0);
+
+    name = xmlStrndup(p, len);
+    if(xmlValidateQName(name, 0) == 0) {
+        colon = BAD_CAST xmlStrchr(name, ':');
+        if(colon == NULL) {
+            subset->subtree_name = xmlStrdup(name);
+        } else {
+            /* an undefined prefix is left for XPath to report */
+            *colon = '\0';
+            for(i = 0; i < subset->ns_nr; i++) {
+                if(xmlStrEqual(subset->namespaces[2 * i], name)) {
+                    subset->subtree_href =
+                        xmlStrdup(subset->namespaces[2 * i + 1]);
+                    subset->subtree_name = xmlStrdup(colon + 1);
+                }
+            }
+        }
+    }
+    xmlFree(name);
+    return(0);
+}
+
+static void
+free_xpath_expr (c14n_subset *subset) {
+    int i;
+
+    for(i = 0; i < 2 * subset->ns_nr; i++) xmlFree(subset->namespaces[i]);
+    xmlFree(subset->namespaces);
+    if(subset->expr != NULL) xmlXPathFreeCompExpr(subset->expr);
+    xmlFree(subset->subtree_name);
+    xmlFree(subset->subtree_href);
+}
+
+/*
+ * The visibility callback for the whole element subset: a node is
+ * visible inside an element with the subset's name (attributes and
+ * namespace nodes inside their parent element)
+ */
+static int
+subtree_visible (void *user_data, xmlNodePtr node, xmlNodePtr parent) {
+    c14n_subset *subset = user_data;
+    xmlNodePtr cur;
+
+    if(node == NULL) return(0);
+    cur = (node->type == XML_NAMESPACE_DECL ||
+           node->type == XML_ATTRIBUTE_NODE) ? parent : node;
+    for(; cur != NULL; cur = cur->parent) {
+        if(cur->type == XML_ELEMENT_NODE &&
+           xmlStrEqual(cur->name, subset->subtree_name) &&
+           ((cur->ns == NULL) ? (subset->subtree_href == NULL) :
+            xmlStrEqual(cur->ns->href, subset->subtree_href)))
+            return(1);
+    }
+    return(0);
+}
+
+static xmlXPathObjectPtr
+eval_xpath_expr (xmlDocPtr doc, c14n_subset *subset) {
+    xmlXPathObjectPtr xpath; 
+    xmlXPathContextPtr ctx; 
+    xmlChar **ns;
+
+    ctx = xmlXPathNewContext(doc);
     if(ctx == NULL) {
         fprintf(stderr,"Error: unable to create new context\n");
-        xmlFree(expr); 
-        xmlFreeDoc(doc); 
         return(NULL);
     }
 
     /*
      * Register namespaces
      */
-    ns = node->nsDef;
-    while(ns != NULL) {
-        if(xmlXPathRegisterNs(ctx, ns->prefix, ns->href) != 0) {
-            fprintf(stderr,"Error: unable to register NS with prefix=\"%s\" and href=\"%s\"\n", ns->prefix, ns->href);
-                xmlFree(expr); 
+    for(ns = subset->namespaces; ns < subset->namespaces + 2 * subset->ns_nr; ns += 2) {
+        if(xmlXPathRegisterNs(ctx, ns[0], ns[1]) != 0) {
+            fprintf(stderr,"Error: unable to register NS with prefix=\"%s\" and href=\"%s\"\n", ns[0], ns[1]);
             xmlXPathFreeContext(ctx); 
-            xmlFreeDoc(doc); 
             return(NULL);
         }
-        ns = ns->next;
     }
 
     /*  
      * Evaluate xpath
      */
-    xpath = xmlXPathEvalExpression(expr, ctx);
+    xpath = xmlXPathCompiledEval(subset->expr, ctx);
     if(xpath == NULL) {
         fprintf(stderr,"Error: unable to evaluate xpath expression\n");
-            xmlFree(expr); 
-        xmlXPathFreeContext(ctx); 
-        xmlFreeDoc(doc); 
-        return(NULL);
     }
 
     /* print_xpath_nodes(xpath->nodesetval); */
 
-    xmlFree(expr); 
     xmlXPathFreeContext(ctx); 
-    xmlFreeDoc(doc); 
     return(xpath);
 }
 
@@ -26,19 +26,37 @@ THE SOFTWARE.
 
 */
 
+#include <config.h>
+
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include <string.h>
-#include <strings.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 #include <libxml/xmlmemory.h>
 
 #include "xmlstar.h"
 #include "escape.h"
+#include "scan.h"
+
+#if !HAVE_DECL_O_BINARY
+# define O_BINARY 0
+#endif
+
+/* initial size of the input buffer, it grows to hold the longest line */
+#define DEPYX_READ_SIZE (1024 * 1024)
+
+/* size of the output buffer, it is written out when full */
+#define DEPYX_OUTPUT_SIZE (256 * 1024)
 
-#define INSZ 4*1024
+/* state of a conversion */
+typedef struct _depyxContext {
+   char *out;                 /* DEPYX_OUTPUT_SIZE bytes of output */
+   size_t used;
+   int parseattrs;            /* inside a start tag, '>' not written yet */
+} depyxContext;
 
 static void
 depyxUsage(int argc, char **argv, exit_status status)
@@ -52,145 +70,258 @@ depyxUsage(int argc, char **argv, exit_status status)
 }
 
 /**
- *  Decode PYX string
- *
+ *  Write out the buffered output
  */
-void
-pyxDecode(char *str, xml_C14NNormalizationMode mode)
+static void
+depyxFlush(depyxContext *ctx)
 {
-   while (*str)
+   if (ctx->used) fwrite(ctx->out, 1, ctx->used, stdout);
+   ctx->used = 0;
+}
+
+/**
+ *  Output @len bytes at @s
+ */
+static void
+depyxWrite(depyxContext *ctx, const char *s, size_t len)
+{
+   if (len > DEPYX_OUTPUT_SIZE - ctx->used)
    {
-      if ((*str == '\\') && (*(str+1) == 'n'))
+      depyxFlush(ctx);
+      if (len >= DEPYX_OUTPUT_SIZE)
       {
-         printf("\n");
-         str++;
+         fwrite(s, 1, len, stdout);
+         return;
       }
-      else if ((*str == '\\') && (*(str+1) == 't'))
-      {
-         printf("\t");
-         str++;
-      }
-      else if ((*str == '\\') && (*(str+1) == '\\'))
+   }
+   memcpy(ctx->out + ctx->used, s, len);
+   ctx->used += len;
+}
+
+static void
+depyxPutc(depyxContext *ctx, char c)
+{
+   if (ctx->used == DEPYX_OUTPUT_SIZE) depyxFlush(ctx);
+   ctx->out[ctx->used++] = c;
+}
+
+#define depyxPuts(ctx, s) depyxWrite((ctx), (s), sizeof(s) - 1)
+
+/**
+ *  Decode the PYX string [@str, @end): undo the \n, \t and \\ escapes
+ *  and escape the XML markup characters for @mode, copying the runs of
+ *  bytes in between at once
+ */
+static void
+pyxDecode(depyxContext *ctx, const char *str, const char *end,
+          xml_C14NNormalizationMode mode)
+{
+   while (str < end)
+   {
+      const char *p;
+
+      switch (mode)
       {
-         printf("\\");
-         str++;
+      case XML_C14N_NORMALIZE_ATTR:
+         p = scanChr4(str, end, '\\', '<', '&', '"');
+         break;
+      case XML_C14N_NORMALIZE_TEXT:
+         p = scanChr4(str, end, '\\', '<', '>', '&');
+         break;
+      default:
+         p = memchr(str, '\\', end - str);
+         if (p == NULL) p = end;
       }
-      else
+      depyxWrite(ctx, str, p - str);
+      if (p == end) break;
+
+      switch (*p)
       {
-         if ((*str == '<') && ((mode == XML_C14N_NORMALIZE_ATTR) ||
-                              (mode == XML_C14N_NORMALIZE_TEXT))) {
-            printf("&lt;");
-         } 
-         else if ((*str == '>') && (mode == XML_C14N_NORMALIZE_TEXT)) {
-            printf("&gt;");
-         } 
-         else if ((*str == '&') && ((mode == XML_C14N_NORMALIZE_ATTR) ||
-                                     (mode == XML_C14N_NORMALIZE_TEXT))) {
-            printf("&amp;");
-         } 
-         else if ((*str == '"') && (mode == XML_C14N_NORMALIZE_ATTR)) {
-            printf("&quot;");
-         } 
-         else {
-            printf("%c", *str);
+      case '\\':
+         /* \n, \t and \\ are escapes, any other backslash is literal */
+         if (p + 1 < end && (p[1] == 'n' || p[1] == 't' || p[1] == '\\'))
+         {
+            p++;
+            depyxPutc(ctx, *p == 'n'? '\n' : *p == 't'? '\t' : '\\');
+         }
+         else
+         {
+            depyxPutc(ctx, '\\');
          }
+         break;
+      case '<':
+         depyxPuts(ctx, "&lt;");
+         break;
+      case '>':
+         depyxPuts(ctx, "&gt;");
+         break;
+      case '&':
+         depyxPuts(ctx, "&amp;");
+         break;
+      default:
+         depyxPuts(ctx, "&quot;");
       }
-      str++;
+      str = p + 1;
+   }
+}
+
+/**
+ *  Convert the PYX line [@line, @end), without its line terminator
+ */
+static void
+depyxLine(depyxContext *ctx, const char *line, const char *end)
+{
+   if (end > line && end[-1] == '\r') end--;
+
+   if (ctx->parseattrs && (line == end || line[0] != 'A')) {
+      ctx->parseattrs = 0;
+      depyxPutc(ctx, '>');
+   }
+   if (line == end) return;
+
+   switch (line[0]) {
+   case '(':
+      depyxPutc(ctx, '<');
+      depyxWrite(ctx, line + 1, end - line - 1);
+      ctx->parseattrs = 1;
+      break;
+   case 'A': {
+      /* attribute */
+      const char *value = memchr(line + 1, ' ', end - line - 1);
+      depyxPutc(ctx, ' ');
+      depyxWrite(ctx, line + 1, (value? value : end) - line - 1);
+      if (value != NULL) {
+         depyxPuts(ctx, "=\"");
+         pyxDecode(ctx, value + 1, end, XML_C14N_NORMALIZE_ATTR);
+         depyxPutc(ctx, '"');
+      }
+      break;
+   }
+   case '-':
+      /* text */
+      pyxDecode(ctx, line + 1, end, XML_C14N_NORMALIZE_TEXT);
+      break;
+   case '?':
+      /* processing instruction */
+      depyxPuts(ctx, "<?");
+      pyxDecode(ctx, line + 1, end, XML_C14N_NORMALIZE_TEXT);
+      depyxPuts(ctx, "?>\n");  /* is this newline correct? */
+      break;
+   case 'D':
+      /* document type declaration */
+      depyxPuts(ctx, "<!DOCTYPE");
+      pyxDecode(ctx, line + 1, end, XML_C14N_NORMALIZE_TEXT);
+      depyxPuts(ctx, ">\n");
+      break;
+   case 'C':
+      /* comment */
+      depyxPuts(ctx, "<!--");
+      pyxDecode(ctx, line + 1, end, XML_C14N_NORMALIZE_TEXT);
+      depyxPuts(ctx, "-->\n");
+      break;
+   case '[':
+      /* CDATA */
+      depyxPuts(ctx, "<![CDATA[");
+      pyxDecode(ctx, line + 1, end, XML_C14N_NORMALIZE_NOTHING);
+      depyxPuts(ctx, "]]>\n");
+      break;
+   case ')':
+      depyxPuts(ctx, "</");
+      depyxWrite(ctx, line + 1, end - line - 1);
+      depyxPutc(ctx, '>');
+      break;
    }
 }
 
 /**
  *  Decode PYX file
  *
+ *  The input is read in large chunks and split into lines in place, the
+ *  buffer grows as needed to hold a complete line
  */
 int
 pyxDePyx(char *file)
 {
-   static char line[INSZ];
-   FILE *in = stdin;
-   int parseattrs;
+   depyxContext ctx;
+   char *buf;
+   size_t size = DEPYX_READ_SIZE, len = 0;
+   int fd = 0, ret = EXIT_SUCCESS;
 
    if (strcmp(file, "-"))
    {
-       in = fopen(file, "r");
-       if (in == NULL)
+       fd = open(file, O_RDONLY | O_BINARY);
+       if (fd < 0)
        {
           fprintf(stderr, "error: could not open: %s\n", file);
           exit(EXIT_BAD_FILE);
        }
    }
-   
-   parseattrs = 0;
-   while (fgets(line, INSZ - 1, in) != NULL)
+#if HAVE_SETMODE && HAVE_DECL_O_BINARY
+   else
    {
-       if(line[strlen(line)-1] == '\n') line[strlen(line)-1] = '\0';
+       setmode(fd, O_BINARY);
+   }
+#endif
 
-       if (parseattrs  && line[0] != 'A') {
-           parseattrs = 0;
-           printf(">");
-       }
-       switch (line[0]) {
-       case '(':
-           printf("<%s", line+1);
-           parseattrs = 1;
-           break;
-       case 'A': {
-           /* attribute */
-           char *value = index(line+1, ' ');
-           if (value != NULL) *value++ = '\0';
-           printf(" %s", line+1);
-           if (value != NULL) {
-               printf("=\"");
-               pyxDecode(value, XML_C14N_NORMALIZE_ATTR);
-               printf("\"");
-           }
-           break;
-       }
-       case '-':
-           /* text */
-           pyxDecode(line+1, XML_C14N_NORMALIZE_TEXT);
-           break;
-       case '?':
-           /* processing instruction */
-           printf("<?");
-           pyxDecode(line+1, XML_C14N_NORMALIZE_TEXT);
-           printf("?>");
-           printf("\n");  /* is this correct? */
-           break;
-       case 'D':
-           /* processing instruction */
-           printf("<!DOCTYPE");
-           pyxDecode(line+1, XML_C14N_NORMALIZE_TEXT);
-           printf(">");
-           printf("\n");  /* is this correct? */
-           break;
-       case 'C':
-           /* comment */
-           printf("<!--");
-           pyxDecode(line+1, XML_C14N_NORMALIZE_TEXT);
-           printf("-->");
-           printf("\n");  /* is this correct? */
-           break;
-       case '[':
-           /* CDATA */
-           printf("<![CDATA[");
-           pyxDecode(line+1, XML_C14N_NORMALIZE_NOTHING);
-           printf("]]>");
-           printf("\n");  /* is this correct? */
-           break;
-       case ')':
-           printf("</%s>", line+1);
-           break;
-       }
+   memset(&ctx, 0, sizeof(ctx));
+   ctx.out = xmlMalloc(DEPYX_OUTPUT_SIZE);
+   buf = xmlMalloc(size);
+   if (!ctx.out || !buf)
+   {
+      fprintf(stderr, "out of memory\n");
+      exit(EXIT_INTERNAL_ERROR);
    }
-   if (ferror(in))
+
+   for (;;)
    {
-      fprintf(stderr, "error reading file: %s: %s",
-          in == stdin ? "stdin" : file, strerror(errno));
-      return EXIT_BAD_FILE;
+      const char *p, *end, *eol;
+      int n = read(fd, buf + len, size - len);
+
+      if (n < 0)
+      {
+         if (errno == EINTR) continue;
+         fprintf(stderr, "error reading file: %s: %s\n",
+             fd == 0 ? "stdin" : file, strerror(errno));
+         ret = EXIT_BAD_FILE;
+         break;
+      }
+      len += n;
+
+      p = buf;
+      end = buf + len;
+      while ((eol = memchr(p, '\n', end - p)) != NULL)
+      {
+         depyxLine(&ctx, p, eol);
+         p = eol + 1;
+      }
+      if (n == 0)
+      {
+         /* last line without a line terminator */
+         if (p < end) depyxLine(&ctx, p, end);
+         break;
+      }
+
+      /* keep the incomplete last line for the next read */
+      len = end - p;
+      memmove(buf, p, len);
+      if (len == size)
+      {
+         size *= 2;
+         buf = xmlRealloc(buf, size);
+         if (!buf)
+         {
+            fprintf(stderr, "out of memory\n");
+            exit(EXIT_INTERNAL_ERROR);
+         }
+      }
    }
 
-   return EXIT_SUCCESS;
+   depyxFlush(&ctx);
+   xmlFree(ctx.out);
+   xmlFree(buf);
+   if (fd != 0) close(fd);
+
+   return ret;
 }
 
 /**
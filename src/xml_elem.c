@@ -29,12 +29,12 @@ THE SOFTWARE.
 #include <config.h>
 
 #include <libxml/xmlstring.h>
-#include <libxml/hash.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "xmlstar.h"
 #include "escape.h"
+#include "jobs.h"
 
 /* TODO:
 
@@ -47,17 +47,77 @@ THE SOFTWARE.
 
 */
 
+/* how the sorted unique paths are printed */
+typedef enum {
+    EL_LINES,                 /* the path */
+    EL_COUNTS,                /* number of elements and path, as uniq -c */
+    EL_TSV,                   /* path, number of elements and of files */
+    EL_JSON                   /* the same as a JSON array of objects */
+} elFormat;
+
 typedef struct _elOptions {
     int show_attr;            /* show attributes */
     int show_attr_and_val;    /* show attributes and values */
     int sort_uniq;            /* do sort and uniq on output */
+    elFormat format;          /* how to print unique paths */
     int check_depth;          /* limit depth */
+    int jobs;                 /* number of files to read in parallel */
+    const char *files_from;   /* file with names of more input files */
 } elOptions;
 
 
+/* path of the current element: the names of its ancestors and itself
+   separated by '/', with the length of the path at every level */
+typedef struct _elPath {
+    xmlChar *buf;
+    int size;
+    int *ends;                /* ends[d]: length of the path down to depth d */
+    const xmlChar **names;    /* names[d]: interned name at depth d */
+    int levels;               /* size of ends and names */
+    int depth;                /* depth of the current element, -1 at start */
+} elPath;
+
+/* a distinct element path, the children are the paths one level down */
+typedef struct _elNode {
+    const xmlChar *name;      /* from the reader's dictionary */
+    unsigned long count;      /* number of elements with this path */
+    unsigned long files;      /* number of files with such elements */
+    int file;                 /* the last file counted in files */
+    struct _elNode *children;
+    struct _elNode *next;
+} elNode;
+
+/* the distinct paths of a document, for -u, -c and -d */
+typedef struct _elTree {
+    elNode root;              /* root.children are the document elements */
+    elNode **stack;           /* stack[d]: node of the current element at depth d */
+    int levels;               /* size of stack */
+} elTree;
+
+/* a line of sorted output */
+typedef struct _elLine {
+    xmlChar *path;
+    unsigned long count;
+    unsigned long files;
+} elLine;
+
+/* what is kept from one input file to the next */
+typedef struct _elState {
+    xmlTextReaderPtr reader;  /* reused, so all files share its dictionary */
+    elTree *tree;             /* distinct paths, for -u, -c and -d */
+    elPath path;
+} elState;
+
+/* all input files, for the job handlers */
+typedef struct _elJob {
+    char **files;
+    int nfiles;
+    elTree *tree;             /* distinct paths of all files */
+    xmlDictPtr dict;          /* names in tree */
+    int status;
+} elJob;
+
 static elOptions elOps;
-static xmlHashTablePtr uniq = NULL;
-static xmlChar *curXPath = NULL;
 
 /**
  *  Display usage syntax
@@ -74,92 +134,311 @@ elUsage(int argc, char **argv, exit_status status)
 }
 
 /**
- *  read file and print element paths
+ *  Make @name the element at @depth of @path: everything below @depth is
+ *  dropped and the name appended, so every element costs the length of
+ *  its own name only.  Names come from the reader's dictionary, a
+ *  sibling with the same name as the previous one leaves the path as it is.
  */
-int
-parse_xml_file(const char *filename)
+static void
+elPathPush(elPath *path, int depth, const xmlChar *name)
 {
-    int ret, prev_depth = 0;
-    xmlTextReaderPtr reader;
+    int start, len;
 
-    for (reader = xmlReaderForFile(filename, NULL, 0);;)
+    if (depth <= path->depth && path->names[depth] == name)
     {
-        int depth;
-        const xmlChar *name;
-        xmlReaderTypes type;
+        path->depth = depth;
+        return;
+    }
 
-        if (!reader) {
-            fprintf(stderr, "couldn't read file '%s'\n", filename);
-            exit(EXIT_BAD_FILE);
+    if (depth >= path->levels)
+    {
+        path->levels = path->levels? path->levels * 2 : 64;
+        path->ends = xmlRealloc(path->ends, path->levels * sizeof(int));
+        path->names = xmlRealloc(path->names,
+                                 path->levels * sizeof(xmlChar *));
+        if (!path->ends || !path->names)
+        {
+            fprintf(stderr, "out of memory\n");
+            exit(EXIT_INTERNAL_ERROR);
         }
+    }
 
-        ret = xmlTextReaderRead(reader);
-        if (ret <= 0) break;
-        type = xmlTextReaderNodeType(reader);
-        depth = xmlTextReaderDepth(reader);
-        name = xmlTextReaderConstName(reader);
+    start = (depth > 0)? path->ends[depth - 1] : 0;
+    len = xmlStrlen(name);
+    if (start + len + 2 > path->size)
+    {
+        while (start + len + 2 > path->size)
+            path->size = path->size? path->size * 2 : 1024;
+        path->buf = xmlRealloc(path->buf, path->size);
+        if (!path->buf)
+        {
+            fprintf(stderr, "out of memory\n");
+            exit(EXIT_INTERNAL_ERROR);
+        }
+    }
+
+    if (depth > 0) path->buf[start++] = '/';
+    memcpy(path->buf + start, name, len);
+    path->buf[start + len] = '\0';
+    path->ends[depth] = start + len;
+    path->names[depth] = name;
+    path->depth = depth;
+}
+
+/**
+ *  Get the path of the current element, as a string
+ */
+static const xmlChar *
+elPathString(elPath *path)
+{
+    /* a sibling may have left a longer path behind */
+    path->buf[path->ends[path->depth]] = '\0';
+    return path->buf;
+}
+
+/**
+ *  Find the child of @parent named @name, adding it if there is none.
+ *  The name is compared by pointer first, as it normally comes from the
+ *  reader's dictionary; a found child moves to the front of the list, so
+ *  runs of elements with the same name are found at once.
+ */
+static elNode *
+elNodeChild(elNode *parent, const xmlChar *name)
+{
+    elNode *cur, *prev = NULL;
+
+    for (cur = parent->children; cur; prev = cur, cur = cur->next)
+        if (cur->name == name) break;
+    if (!cur)
+    {
+        for (prev = NULL, cur = parent->children; cur; prev = cur, cur = cur->next)
+            if (xmlStrEqual(cur->name, name)) break;
+    }
+
+    if (cur)
+    {
+        if (prev)
+        {
+            prev->next = cur->next;
+            cur->next = parent->children;
+            parent->children = cur;
+        }
+        return cur;
+    }
+
+    cur = xmlMalloc(sizeof(elNode));
+    if (!cur)
+    {
+        fprintf(stderr, "out of memory\n");
+        exit(EXIT_INTERNAL_ERROR);
+    }
+    cur->name = name;
+    cur->count = 0;
+    cur->files = 0;
+    cur->file = -1;
+    cur->children = NULL;
+    cur->next = parent->children;
+    parent->children = cur;
+    return cur;
+}
+
+/**
+ *  Count an element named @name at @depth of input @file, below the
+ *  last element counted at @depth - 1
+ */
+static void
+elTreeAdd(elTree *tree, int depth, const xmlChar *name, int file)
+{
+    elNode *node;
+
+    if (depth >= tree->levels)
+    {
+        tree->levels = tree->levels? tree->levels * 2 : 64;
+        tree->stack = xmlRealloc(tree->stack, tree->levels * sizeof(elNode *));
+        if (!tree->stack)
+        {
+            fprintf(stderr, "out of memory\n");
+            exit(EXIT_INTERNAL_ERROR);
+        }
+    }
+
+    node = elNodeChild(depth > 0? tree->stack[depth - 1] : &tree->root, name);
+    node->count++;
+    if (node->file != file)
+    {
+        node->file = file;
+        node->files++;
+    }
+    tree->stack[depth] = node;
+}
+
+/**
+ *  Add the counts of @src, its siblings and their descendants to the
+ *  children of @dst; names are copied to @dict as @src's belong to a
+ *  reader that goes away
+ */
+static void
+elNodeMerge(elNode *dst, elNode *src, xmlDictPtr dict)
+{
+    for (; src; src = src->next)
+    {
+        const xmlChar *name = xmlDictLookup(dict, src->name, -1);
+        elNode *node;
+
+        if (!name)
+        {
+            fprintf(stderr, "out of memory\n");
+            exit(EXIT_INTERNAL_ERROR);
+        }
+        node = elNodeChild(dst, name);
+        node->count += src->count;
+        node->files += src->files;
+        elNodeMerge(node, src->children, dict);
+    }
+}
+
+static elTree *
+elTreeCreate(void)
+{
+    elTree *tree = xmlMalloc(sizeof(elTree));
+    if (!tree)
+    {
+        fprintf(stderr, "out of memory\n");
+        exit(EXIT_INTERNAL_ERROR);
+    }
+    memset(tree, 0, sizeof(elTree));
+    return tree;
+}
+
+static void
+elNodeFree(elNode *node)
+{
+    while (node)
+    {
+        elNode *next = node->next;
+        elNodeFree(node->children);
+        xmlFree(node);
+        node = next;
+    }
+}
+
+static void
+elTreeFree(elTree *tree)
+{
+    elNodeFree(tree->root.children);
+    xmlFree(tree->stack);
+    xmlFree(tree);
+}
+
+/**
+ *  Write @len bytes of @str to a job's @out buffer, or to stdout if
+ *  there is none (@len < 0 for the whole string)
+ */
+static void
+elWrite(xmlBufferPtr out, const xmlChar *str, int len)
+{
+    if (len < 0) len = xmlStrlen(str);
+    if (out)
+        xmlBufferAdd(out, str, len);
+    else
+        fwrite(str, 1, len, stdout);
+}
 
-        if (type != XML_READER_TYPE_ELEMENT)
+/**
+ *  read file @filename (input file number @file) and print element paths
+ *  to @out, or count them in @state's tree
+ */
+int
+parse_xml_file(elState *state, const char *filename, int file,
+               xmlBufferPtr out)
+{
+    int ret;
+    xmlTextReaderPtr reader = state->reader;
+
+    if (!reader)
+        reader = state->reader = xmlReaderForFile(filename, NULL, 0);
+    else if (xmlReaderNewFile(reader, filename, NULL, 0) != 0)
+        reader = NULL;
+    if (!reader) {
+        fprintf(stderr, "couldn't read file '%s'\n", filename);
+        return EXIT_BAD_FILE;
+    }
+    state->path.depth = -1;
+
+    while ((ret = xmlTextReaderRead(reader)) > 0)
+    {
+        int depth;
+        const xmlChar *path;
+
+        if (xmlTextReaderNodeType(reader) != XML_READER_TYPE_ELEMENT)
             continue;
 
-        while (curXPath && depth <= prev_depth)
+        depth = xmlTextReaderDepth(reader);
+        if (state->tree)
         {
-            xmlChar *slash = BAD_CAST strrchr((char*) curXPath, '/');
-            if (slash) *slash = '\0';
-            prev_depth--;
+            /* only the tree is needed, the path string is built when
+               printing it */
+            if (elOps.check_depth == 0 || depth < elOps.check_depth)
+                elTreeAdd(state->tree, depth,
+                          xmlTextReaderConstName(reader), file);
+            continue;
         }
-        prev_depth = depth;
 
-        if (depth > 0) curXPath = xmlStrcat(curXPath, BAD_CAST "/");
-        curXPath = xmlStrcat(curXPath, name);
+        elPathPush(&state->path, depth, xmlTextReaderConstName(reader));
+        path = elPathString(&state->path);
 
         if (elOps.show_attr)
         {
             int have_attr;
 
-            fprintf(stdout, "%s\n", curXPath);
+            elWrite(out, path, state->path.ends[depth]);
+            elWrite(out, BAD_CAST "\n", 1);
             for (have_attr = xmlTextReaderMoveToFirstAttribute(reader);
                  have_attr;
                  have_attr = xmlTextReaderMoveToNextAttribute(reader))
             {
                 const xmlChar *aname = xmlTextReaderConstName(reader);
-                fprintf(stdout, "%s/@%s\n", curXPath, aname);
+                elWrite(out, path, state->path.ends[depth]);
+                elWrite(out, BAD_CAST "/@", 2);
+                elWrite(out, aname, -1);
+                elWrite(out, BAD_CAST "\n", 1);
             }
         }
         else if (elOps.show_attr_and_val)
         {
-            fprintf(stdout, "%s", curXPath);
+            elWrite(out, path, state->path.ends[depth]);
             if (xmlTextReaderHasAttributes(reader))
             {
                 int have_attr, first = 1;
-                fprintf(stdout, "[");
+                elWrite(out, BAD_CAST "[", 1);
                 for (have_attr = xmlTextReaderMoveToFirstAttribute(reader);
                      have_attr;
                      have_attr = xmlTextReaderMoveToNextAttribute(reader))
                 {
                     const xmlChar *aname = xmlTextReaderConstName(reader),
                         *avalue = xmlTextReaderConstValue(reader);
-                    char quote;
+                    const xmlChar *quote;
                     if (!first)
-                        fprintf(stdout, " and ");
+                        elWrite(out, BAD_CAST " and ", 5);
                     first = 0;
 
-                    quote = xmlStrchr(avalue, '\'')? '"' : '\'';
-                    fprintf(stdout, "@%s=%c%s%c", aname, quote, avalue, quote);
+                    quote = xmlStrchr(avalue, '\'')? BAD_CAST "\"" : BAD_CAST "'";
+                    elWrite(out, BAD_CAST "@", 1);
+                    elWrite(out, aname, -1);
+                    elWrite(out, BAD_CAST "=", 1);
+                    elWrite(out, quote, 1);
+                    elWrite(out, avalue, -1);
+                    elWrite(out, quote, 1);
                 }
-                fprintf(stdout, "]");
+                elWrite(out, BAD_CAST "]", 1);
             }
-            fprintf(stdout, "\n");
+            elWrite(out, BAD_CAST "\n", 1);
         }
-        else if (elOps.sort_uniq)
+        else
         {
-            if ((elOps.check_depth == 0) || (elOps.check_depth != 0 && depth < elOps.check_depth))
-            {
-                xmlHashAddEntry(uniq, curXPath, (void*) 1);
-            }
+            elWrite(out, path, state->path.ends[depth]);
+            elWrite(out, BAD_CAST "\n", 1);
         }
-        else fprintf(stdout, "%s\n", curXPath);
-
     }
 
     return ret == -1? EXIT_LIB_ERROR : ret;
@@ -174,34 +453,220 @@ elInitOptions(elOptions *ops)
     ops->show_attr = 0;  
     ops->show_attr_and_val = 0;
     ops->sort_uniq = 0;
+    ops->format = EL_LINES;
     ops->check_depth = 0; 
+    ops->jobs = 1;
+    ops->files_from = NULL;
 }
 
 typedef struct {
-    const xmlChar **array;
+    elLine *array;
     int offset;
+    int size;
 } ArrayDest;
 
 /**
- * put @name into @data->array[@data->offset]
+ * put the paths of @node and its siblings, found at @depth, and of their
+ * descendants into @dest
  */
 static void
-hash_key_put(void *payload, void *data, const xmlChar *name)
+tree_lines_put(elNode *node, int depth, elPath *path, ArrayDest *dest)
 {
-    ArrayDest *dest = data;
-    dest->array[dest->offset++] = name;
+    for (; node; node = node->next)
+    {
+        elPathPush(path, depth, node->name);
+        if (dest->offset == dest->size)
+        {
+            dest->size = dest->size? dest->size * 2 : 256;
+            dest->array = xmlRealloc(dest->array, dest->size * sizeof(elLine));
+            if (!dest->array)
+            {
+                fprintf(stderr, "out of memory\n");
+                exit(EXIT_INTERNAL_ERROR);
+            }
+        }
+        dest->array[dest->offset].path =
+            xmlStrndup(path->buf, path->ends[depth]);
+        dest->array[dest->offset].count = node->count;
+        dest->array[dest->offset].files = node->files;
+        dest->offset++;
+        tree_lines_put(node->children, depth + 1, path, dest);
+    }
 }
 
 /**
  * a compare function for qsort
- * takes pointers to 2 xmlChar* and compares them
+ * takes pointers to 2 elLine and compares their paths
+ */
+static int
+compare_line_path(const void *p1, const void *p2)
+{
+    const elLine *line1 = p1, *line2 = p2;
+    return xmlStrcmp(line1->path, line2->path);
+}
+
+/**
+ *  Print the distinct paths of @tree, sorted as sort(1) would
+ *  (a path followed by its children is not always in order, "a/b"
+ *  sorts after "a-b")
+ */
+static void
+print_tree_lines(elTree *tree)
+{
+    int i;
+    ArrayDest lines;
+    elPath path;
+
+    memset(&path, 0, sizeof(path));
+    path.depth = -1;
+    lines.array = NULL;
+    lines.offset = lines.size = 0;
+    tree_lines_put(tree->root.children, 0, &path, &lines);
+
+    if (lines.offset > 1)
+        qsort(lines.array, lines.offset, sizeof(elLine), compare_line_path);
+
+    if (elOps.format == EL_JSON) printf("[");
+    for (i = 0; i < lines.offset; i++)
+    {
+        elLine *line = &lines.array[i];
+
+        /* XML names have no characters to escape in JSON strings */
+        switch (elOps.format)
+        {
+        case EL_LINES:
+            printf("%s\n", line->path);
+            break;
+        case EL_COUNTS:
+            printf("%7lu %s\n", line->count, line->path);
+            break;
+        case EL_TSV:
+            printf("%s\t%lu\t%lu\n", line->path, line->count, line->files);
+            break;
+        case EL_JSON:
+            printf("%s\n{\"path\": \"%s\", \"count\": %lu, \"files\": %lu}",
+                   i? "," : "", line->path, line->count, line->files);
+            break;
+        }
+        xmlFree(line->path);
+    }
+    if (elOps.format == EL_JSON) printf("\n]\n");
+
+    xmlFree(lines.array);
+    xmlFree(path.buf);
+    xmlFree(path.ends);
+    xmlFree(path.names);
+}
+
+/**
+ *  Start a worker: its own reader and, for unique paths, its own tree
+ */
+static void *
+el_init_state(void *shared)
+{
+    elState *state = xmlMalloc(sizeof(elState));
+
+    if (!state)
+    {
+        fprintf(stderr, "out of memory\n");
+        exit(EXIT_INTERNAL_ERROR);
+    }
+    memset(state, 0, sizeof(elState));
+    if (((elJob *) shared)->tree)
+        state->tree = elTreeCreate();
+    return state;
+}
+
+static int
+el_run_file(void *shared, void *local, int item, xmlBufferPtr out)
+{
+    elJob *job = shared;
+    return parse_xml_file(local, job->files[item], item, out);
+}
+
+static void
+el_done_file(void *shared, int item, int status, xmlBufferPtr out)
+{
+    elJob *job = shared;
+
+    if (out)
+        fwrite(xmlBufferContent(out), 1, xmlBufferLength(out), stdout);
+    if (status) job->status = status;
+}
+
+/**
+ *  Merge a worker's paths into the job's tree and free the worker
+ */
+static void
+el_fini_state(void *shared, void *local)
+{
+    elJob *job = shared;
+    elState *state = local;
+
+    if (!state) return;
+    if (state->tree)
+    {
+        elNodeMerge(&job->tree->root, state->tree->root.children, job->dict);
+        elTreeFree(state->tree);
+    }
+    xmlFreeTextReader(state->reader);
+    xmlFree(state->path.buf);
+    xmlFree(state->path.ends);
+    xmlFree(state->path.names);
+    xmlFree(state);
+}
+
+/**
+ *  Add the files named in @listname to @job's files; returns 0 if the
+ *  list can not be read
  */
 static int
-compare_string_ptr(const void *p1, const void *p2)
+el_files_from(elJob *job, const char *listname)
+{
+    FILE *list = stdin;
+    char *line = NULL;
+    size_t size = 0;
+    int nalloc = job->nfiles;
+
+    if (strcmp(listname, "-"))
+    {
+        list = fopen(listname, "r");
+        if (list == NULL)
+        {
+            fprintf(stderr, "Error: could not open: %s\n", listname);
+            return 0;
+        }
+    }
+
+    while (readListLine(list, &line, &size))
+    {
+        if (job->nfiles == nalloc)
+        {
+            nalloc = nalloc < 64? 64 : nalloc * 2;
+            job->files = xmlRealloc(job->files, nalloc * sizeof(char *));
+            if (!job->files)
+            {
+                fprintf(stderr, "out of memory\n");
+                exit(EXIT_INTERNAL_ERROR);
+            }
+        }
+        job->files[job->nfiles++] = (char *) xmlStrdup(BAD_CAST line);
+    }
+    xmlFree(line);
+
+    if (list != stdin) fclose(list);
+    return 1;
+}
+
+static const char *
+el_option_arg(int argc, char **argv, int i)
 {
-    typedef xmlChar const *const xmlCChar;
-    xmlCChar *str1 = p1, *str2 = p2;
-    return xmlStrcmp(*str1, *str2);
+    if (i + 1 >= argc)
+    {
+        fprintf(stderr, "error: %s needs an argument\n", argv[i]);
+        elUsage(argc, argv, EXIT_BAD_ARGS);
+    }
+    return argv[i + 1];
 }
 
 /**
@@ -210,77 +675,113 @@ compare_string_ptr(const void *p1, const void *p2)
 int
 elMain(int argc, char **argv)
 {
-    int errorno = 0;
-    char* inp_file = "-";
+    static const jobHandlers el_handlers =
+        { el_init_state, el_run_file, el_done_file, el_fini_state };
+    int i, nargs;
+    elJob job;
 
     if (argc <= 1) elUsage(argc, argv, EXIT_BAD_ARGS);
 
     elInitOptions(&elOps);
 
-    if (argc == 2)
-        errorno = parse_xml_file("-");  
-    else
+    for (i = 2; i < argc && argv[i][0] == '-' && argv[i][1] != '\0'; i++)
     {
-        if (!strcmp(argv[2], "--help") || !strcmp(argv[2], "-h") ||
-            !strcmp(argv[2], "-?") || !strcmp(argv[2], "-Z"))
+        if (!strcmp(argv[i], "--help") || !strcmp(argv[i], "-h") ||
+            !strcmp(argv[i], "-?") || !strcmp(argv[i], "-Z"))
         {
             elUsage(argc, argv, EXIT_SUCCESS);
         }
-        else if (!strcmp(argv[2], "-a"))
+        else if (!strcmp(argv[i], "-a"))
         {
             elOps.show_attr = 1;
-            if (argc >= 4) inp_file = argv[3];
-            errorno = parse_xml_file(inp_file);
         }
-        else if (!strcmp(argv[2], "-v"))
+        else if (!strcmp(argv[i], "-v"))
         {
             elOps.show_attr_and_val = 1;
-            if (argc >= 4) inp_file = argv[3];
-            errorno = parse_xml_file(inp_file);
         }
-        else if (!strcmp(argv[2], "-u"))
+        else if (!strcmp(argv[i], "-u"))
+        {
+            elOps.sort_uniq = 1;
+        }
+        else if (!strcmp(argv[i], "-c"))
+        {
+            /* only one way to print the unique lines */
+            if (elOps.format != EL_LINES) elUsage(argc, argv, EXIT_BAD_ARGS);
+            elOps.sort_uniq = 1;
+            elOps.format = EL_COUNTS;
+        }
+        else if (!strcmp(argv[i], "--tsv"))
+        {
+            /* only one way to print the unique lines */
+            if (elOps.format != EL_LINES) elUsage(argc, argv, EXIT_BAD_ARGS);
+            elOps.sort_uniq = 1;
+            elOps.format = EL_TSV;
+        }
+        else if (!strcmp(argv[i], "--json"))
         {
+            /* only one way to print the unique lines */
+            if (elOps.format != EL_LINES) elUsage(argc, argv, EXIT_BAD_ARGS);
             elOps.sort_uniq = 1;
-            if (argc >= 4) inp_file = argv[3];
-            uniq = xmlHashCreate(0);
-            errorno = parse_xml_file(inp_file);
+            elOps.format = EL_JSON;
         }
-        else if (!strncmp(argv[2], "-d", 2)) 
+        else if (!strncmp(argv[i], "-d", 2)) 
         { 
-            elOps.check_depth = atoi(argv[2]+2); 
-            /* printf("Checking depth (%d)\n", elOps.check_depth); */ 
+            elOps.check_depth = atoi(argv[i]+2); 
             elOps.sort_uniq = 1; 
-            if (argc >= 4) inp_file = argv[3];
-            uniq = xmlHashCreate(0);
-            errorno = parse_xml_file(inp_file); 
         }
-        else if (argv[2][0] != '-')
+        else if (!strcmp(argv[i], "-j") || !strcmp(argv[i], "--jobs"))
         {
-            errorno = parse_xml_file(argv[2]);
+            elOps.jobs = parseJobCount(el_option_arg(argc, argv, i++));
+            if (elOps.jobs == 0) elUsage(argc, argv, EXIT_BAD_ARGS);
+        }
+        else if (!strcmp(argv[i], "--files-from"))
+        {
+            elOps.files_from = el_option_arg(argc, argv, i++);
         }
         else
             elUsage(argc, argv, EXIT_BAD_ARGS);
     }
 
-    if (uniq)
-    {
-        int i;
-        ArrayDest lines;
-        lines.array = xmlMalloc(sizeof(xmlChar*) * xmlHashSize(uniq));
-        lines.offset = 0;
-        xmlHashScan(uniq, hash_key_put, &lines);
+    /* the attributes are only shown on the paths of each file */
+    if ((elOps.show_attr || elOps.show_attr_and_val) && elOps.sort_uniq)
+        elUsage(argc, argv, EXIT_BAD_ARGS);
 
-        qsort(lines.array, lines.offset, sizeof(xmlChar*), compare_string_ptr);
+    memset(&job, 0, sizeof(job));
+    job.status = EXIT_SUCCESS;
 
-        for (i = 0; i < lines.offset; i++)
-        {
-            printf("%s\n", lines.array[i]);
-        }
+    /* the names from a --files-from list are added to the arguments,
+       so all files are shared out to the workers together */
+    nargs = argc - i;
+    job.files = xmlMalloc((nargs + 1) * sizeof(char *));
+    if (!job.files)
+    {
+        fprintf(stderr, "out of memory\n");
+        exit(EXIT_INTERNAL_ERROR);
+    }
+    for (job.nfiles = 0; job.nfiles < nargs; job.nfiles++)
+        job.files[job.nfiles] = (char *) xmlStrdup(BAD_CAST argv[i + job.nfiles]);
+    if (nargs == 0 && !elOps.files_from)
+        job.files[job.nfiles++] = (char *) xmlStrdup(BAD_CAST "-");
+    if (elOps.files_from && !el_files_from(&job, elOps.files_from))
+        job.status = EXIT_BAD_FILE;
+
+    if (elOps.sort_uniq && !elOps.show_attr && !elOps.show_attr_and_val)
+    {
+        job.tree = elTreeCreate();
+        job.dict = xmlDictCreate();
+    }
 
-        xmlFree(lines.array);
-        xmlHashFree(uniq, NULL);
+    runJobs(elOps.jobs, job.nfiles, &job, &el_handlers);
+
+    if (job.tree)
+    {
+        print_tree_lines(job.tree);
+        elTreeFree(job.tree);
+        xmlDictFree(job.dict);
     }
+    for (i = 0; i < job.nfiles; i++)
+        xmlFree(job.files[i]);
+    xmlFree(job.files);
 
-    return errorno;
+    return job.status;
 }
-
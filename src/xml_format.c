@@ -31,6 +31,10 @@ THE SOFTWARE.
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 #include <libxml/xmlmemory.h>
 #include <libxml/debugXML.h>
@@ -43,8 +47,14 @@ THE SOFTWARE.
 #include <libxml/parserInternals.h>
 #include <libxml/uri.h>
 #include <libxml/xmlsave.h>
+#ifdef LIBXML_READER_ENABLED
+#define FO_STREAM
+#include <libxml/xmlreader.h>
+#endif
 
 #include "xmlstar.h"
+#include "jobs.h"
+#include "scan.h"
 
 /*
  *  TODO:  1. Attribute formatting options (as every attribute on a new line)
@@ -62,6 +72,12 @@ typedef struct _foOptions {
 #ifdef LIBXML_HTML_ENABLED
     int html;                 /* inputs are in HTML format */
 #endif
+#ifdef FO_STREAM
+    int stream;               /* format while parsing, in constant memory */
+#endif
+    int minify;               /* strip insignificant white space */
+    int inplace;              /* replace the input files with the result */
+    int jobs;                 /* number of files to format in parallel */
     int quiet;                 /* quiet mode */
 } foOptions;
 
@@ -99,6 +115,12 @@ foInitOptions(foOptionsPtr ops)
 #ifdef LIBXML_HTML_ENABLED
     ops->html = 0;
 #endif
+#ifdef FO_STREAM
+    ops->stream = 0;
+#endif
+    ops->minify = 0;
+    ops->inplace = 0;
+    ops->jobs = 1;
     ops->quiet = globalOptions.quiet;
 }
 
@@ -171,6 +193,24 @@ foParseOptions(foOptionsPtr ops, int argc, char **argv)
             ops->indent_tab = 0;
             i++;
         }
+        else if (!strcmp(argv[i], "--minify") || !strcmp(argv[i], "-m"))
+        {
+            ops->minify = 1;
+            i++;
+        }
+        else if (!strcmp(argv[i], "--inplace") || !strcmp(argv[i], "-L"))
+        {
+            ops->inplace = 1;
+            i++;
+        }
+        else if (!strcmp(argv[i], "--jobs") || !strcmp(argv[i], "-j"))
+        {
+            i++;
+            if (i >= argc) foUsage(argc, argv, EXIT_BAD_ARGS);
+            ops->jobs = parseJobCount(argv[i]);
+            if (!ops->jobs) foUsage(argc, argv, EXIT_BAD_ARGS);
+            i++;
+        }
         else if (!strcmp(argv[i], "--quiet") || !strcmp(argv[i], "-Q"))
         {
             ops->quiet = 1;
@@ -182,6 +222,13 @@ foParseOptions(foOptionsPtr ops, int argc, char **argv)
             ops->html = 1;
             i++;
         }
+#endif
+#ifdef FO_STREAM
+        else if (!strcmp(argv[i], "--stream"))
+        {
+            ops->stream = 1;
+            i++;
+        }
 #endif
         else if (!strcmp(argv[i], "--net"))
         {
@@ -212,26 +259,1023 @@ foParseOptions(foOptionsPtr ops, int argc, char **argv)
 }
 
 /**
- *  'process' xml document(s)
+ *  Indentation string for the options, NULL to use the default one;
+ *  the result must be freed with xmlFree()
+ */
+static char *
+foIndentString(foOptionsPtr ops)
+{
+    char *spaces;
+
+    if (ops->indent_tab)
+        return (char *) xmlStrdup(BAD_CAST "\t");
+    if (ops->indent_spaces <= 0)
+        return NULL;
+    spaces = xmlMalloc(ops->indent_spaces + 1);
+    memset(spaces, ' ', ops->indent_spaces);
+    spaces[ops->indent_spaces] = '\0';
+    return spaces;
+}
+
+#ifdef FO_STREAM
+
+/* the tree serializer never indents by more than this many characters */
+#define FO_MAX_INDENT 60
+
+typedef struct _foStreamState {
+    xmlOutputBufferPtr out;
+    xmlCharEncodingOutputFunc escape;   /* for text, NULL for the default */
+    xmlDocPtr escapeDoc;      /* carries the output encoding for attributes */
+    xmlBufferPtr scratch;
+    char indent[FO_MAX_INDENT];
+    int indent_size;          /* length of one indentation step */
+    int indent_nr;            /* maximum number of indentation steps */
+    char *format;             /* per depth: are the children formatted */
+    int format_size;
+    int open;                 /* the last start tag is not closed yet */
+} foStreamState;
+
+/**
+ *  Escape text for output without an encoding, like the tree serializer
+ *  does: markup characters, and everything outside of printable ASCII
+ *  as character references
+ */
+static int
+foEscapeEntities(unsigned char *out, int *outlen,
+                 const xmlChar *in, int *inlen)
+{
+    unsigned char *outstart = out, *outend = out + *outlen;
+    const xmlChar *instart = in, *inend = in + *inlen;
+
+    while (in < inend && out < outend)
+    {
+        char ref[16];
+        const char *rep = ref;
+        int len = 1, val;
+
+        if (*in == '<') rep = "&lt;";
+        else if (*in == '>') rep = "&gt;";
+        else if (*in == '&') rep = "&amp;";
+        else if ((*in >= 0x20 && *in < 0x80) || *in == '\n' || *in == '\t')
+        {
+            *out++ = *in++;
+            continue;
+        }
+        else
+        {
+            len = inend - in;
+            val = xmlGetUTF8Char(in, &len);
+            if (val < 0)
+            {
+                val = *in;
+                len = 1;
+            }
+            sprintf(ref, "&#x%X;", val);
+        }
+        if (outend - out < (int) strlen(rep)) break;
+        memcpy(out, rep, strlen(rep));
+        out += strlen(rep);
+        in += len;
+    }
+
+    *outlen = out - outstart;
+    *inlen = in - instart;
+    return *outlen;
+}
+
+/**
+ *  Write indentation for @level to the output
+ */
+static void
+foStreamIndent(foStreamState *st, int level)
+{
+    if (st->indent_size == 0) return;
+    if (level > st->indent_nr) level = st->indent_nr;
+    xmlOutputBufferWrite(st->out, level * st->indent_size, st->indent);
+}
+
+/**
+ *  Separate a node of type @type at @depth from the preceding content,
+ *  like the tree serializer does when it formats the parent's children
+ */
+static void
+foStreamSeparate(foStreamState *st, int depth, int type)
+{
+    if (depth == 0) return;
+    if (st->open)
+    {
+        xmlOutputBufferWrite(st->out, 1, ">");
+        st->open = 0;
+    }
+    if (!st->format[depth - 1]) return;
+
+    switch (type)
+    {
+    case XML_READER_TYPE_TEXT:
+    case XML_READER_TYPE_WHITESPACE:
+    case XML_READER_TYPE_SIGNIFICANT_WHITESPACE:
+    case XML_READER_TYPE_ENTITY_REFERENCE:
+    case XML_READER_TYPE_CDATA:
+        /* mixed content is written as it is from here on */
+        st->format[depth - 1] = 0;
+        break;
+    default:
+        xmlOutputBufferWrite(st->out, 1, "\n");
+        foStreamIndent(st, depth);
+        break;
+    }
+}
+
+/**
+ *  Close the element at @depth named @name
+ */
+static void
+foStreamEndElement(foStreamState *st, int depth, const xmlChar *name)
+{
+    if (st->open)
+    {
+        xmlOutputBufferWrite(st->out, 2, "/>");
+        st->open = 0;
+    }
+    else
+    {
+        if (st->format[depth])
+        {
+            xmlOutputBufferWrite(st->out, 1, "\n");
+            foStreamIndent(st, depth);
+        }
+        xmlOutputBufferWrite(st->out, 2, "</");
+        xmlOutputBufferWriteString(st->out, (const char *) name);
+        xmlOutputBufferWrite(st->out, 1, ">");
+    }
+    if (depth == 0)
+        xmlOutputBufferWrite(st->out, 1, "\n");
+}
+
+/**
+ *  Write the start tag of the element the @reader is positioned on
+ */
+static void
+foStreamStartElement(foStreamState *st, xmlTextReaderPtr reader, int depth)
+{
+    if (depth >= st->format_size)
+    {
+        st->format_size = (depth + 1) * 2;
+        st->format = xmlRealloc(st->format, st->format_size);
+    }
+    st->format[depth] = depth == 0 || st->format[depth - 1];
+
+    xmlOutputBufferWrite(st->out, 1, "<");
+    xmlOutputBufferWriteString(st->out,
+        (const char *) xmlTextReaderConstName(reader));
+
+    /* namespace declarations come first, as in the tree */
+    if (xmlTextReaderMoveToFirstAttribute(reader) == 1)
+    {
+        do {
+            xmlBufferEmpty(st->scratch);
+            xmlAttrSerializeTxtContent(st->scratch, st->escapeDoc, NULL,
+                                       xmlTextReaderConstValue(reader));
+            xmlOutputBufferWrite(st->out, 1, " ");
+            xmlOutputBufferWriteString(st->out,
+                (const char *) xmlTextReaderConstName(reader));
+            xmlOutputBufferWrite(st->out, 2, "=\"");
+            xmlOutputBufferWrite(st->out, xmlBufferLength(st->scratch),
+                                 (const char *) xmlBufferContent(st->scratch));
+            xmlOutputBufferWrite(st->out, 1, "\"");
+        } while (xmlTextReaderMoveToNextAttribute(reader) == 1);
+        xmlTextReaderMoveToElement(reader);
+    }
+    st->open = 1;
+
+    if (xmlTextReaderIsEmptyElement(reader))
+        foStreamEndElement(st, depth, NULL);
+}
+
+/**
+ *  Write the node the @reader is positioned on
+ */
+static void
+foStreamNode(foOptionsPtr ops, foStreamState *st, xmlTextReaderPtr reader)
+{
+    int type = xmlTextReaderNodeType(reader);
+    int depth = xmlTextReaderDepth(reader);
+    const xmlChar *name = xmlTextReaderConstName(reader);
+    const xmlChar *value;
+
+    if (type == XML_READER_TYPE_END_ELEMENT)
+    {
+        foStreamEndElement(st, depth, name);
+        return;
+    }
+    if (type == XML_READER_TYPE_DOCUMENT_TYPE && ops->dropdtd)
+        return;
+
+    foStreamSeparate(st, depth, type);
+    value = xmlTextReaderConstValue(reader);
+
+    switch (type)
+    {
+    case XML_READER_TYPE_ELEMENT:
+        foStreamStartElement(st, reader, depth);
+        return;
+    case XML_READER_TYPE_TEXT:
+    case XML_READER_TYPE_WHITESPACE:
+    case XML_READER_TYPE_SIGNIFICANT_WHITESPACE:
+        xmlOutputBufferWriteEscape(st->out, value, st->escape);
+        return;
+    case XML_READER_TYPE_ENTITY_REFERENCE:
+        xmlOutputBufferWrite(st->out, 1, "&");
+        xmlOutputBufferWriteString(st->out, (const char *) name);
+        xmlOutputBufferWrite(st->out, 1, ";");
+        return;
+    case XML_READER_TYPE_CDATA:
+        xmlOutputBufferWrite(st->out, 9, "<![CDATA[");
+        xmlOutputBufferWriteString(st->out, (const char *) value);
+        xmlOutputBufferWrite(st->out, 3, "]]>");
+        break;
+    case XML_READER_TYPE_COMMENT:
+        xmlOutputBufferWrite(st->out, 4, "<!--");
+        xmlOutputBufferWriteString(st->out, (const char *) value);
+        xmlOutputBufferWrite(st->out, 3, "-->");
+        break;
+    case XML_READER_TYPE_PROCESSING_INSTRUCTION:
+        xmlOutputBufferWrite(st->out, 2, "<?");
+        xmlOutputBufferWriteString(st->out, (const char *) name);
+        if (value != NULL)
+        {
+            xmlOutputBufferWrite(st->out, 1, " ");
+            xmlOutputBufferWriteString(st->out, (const char *) value);
+        }
+        xmlOutputBufferWrite(st->out, 2, "?>");
+        break;
+    case XML_READER_TYPE_DOCUMENT_TYPE:
+    {
+        /* the DTD is kept in memory by the parser anyway */
+        xmlNodePtr dtd = xmlTextReaderCurrentNode(reader);
+        xmlNodeDumpOutput(st->out, dtd->doc, dtd, 0, 0, NULL);
+        break;
+    }
+    default:
+        return;
+    }
+
+    if (depth == 0)
+        xmlOutputBufferWrite(st->out, 1, "\n");
+}
+
+/**
+ *  Write the XML declaration, the document's properties are known once
+ *  the @reader has read the first node
+ */
+static void
+foStreamDecl(foStreamState *st, xmlTextReaderPtr reader, const char *enc)
+{
+    const xmlChar *version = xmlTextReaderConstXmlVersion(reader);
+
+    xmlOutputBufferWrite(st->out, 14, "<?xml version=");
+    xmlBufferEmpty(st->scratch);
+    xmlBufferWriteQuotedString(st->scratch,
+        version? version : BAD_CAST XML_DEFAULT_VERSION);
+    xmlOutputBufferWrite(st->out, xmlBufferLength(st->scratch),
+                         (const char *) xmlBufferContent(st->scratch));
+    if (enc != NULL)
+    {
+        xmlOutputBufferWrite(st->out, 10, " encoding=");
+        xmlBufferEmpty(st->scratch);
+        xmlBufferWriteQuotedString(st->scratch, BAD_CAST enc);
+        xmlOutputBufferWrite(st->out, xmlBufferLength(st->scratch),
+                             (const char *) xmlBufferContent(st->scratch));
+    }
+    switch (xmlTextReaderStandalone(reader))
+    {
+    case 0:
+        xmlOutputBufferWrite(st->out, 16, " standalone=\"no\"");
+        break;
+    case 1:
+        xmlOutputBufferWrite(st->out, 17, " standalone=\"yes\"");
+        break;
+    }
+    xmlOutputBufferWrite(st->out, 3, "?>\n");
+}
+
+/**
+ *  Format @fileName while it is being parsed: the xmlTextReader nodes are
+ *  written out as soon as they are read, so memory use does not depend
+ *  on the size of the document.  The output is the same as the tree
+ *  serializer's, except that an element whose first text comes after
+ *  some child element is indented up to that text: the tree serializer
+ *  leaves all of such an element alone, which can not be known in time.
+ */
+static int
+foStream(foOptionsPtr ops, const char *fileName, int fd, xmlBufferPtr out)
+{
+    xmlTextReaderPtr reader;
+    foStreamState st;
+    const char *enc = NULL;
+    xmlCharEncodingHandlerPtr handler = NULL;
+    int ret, i, status = 0;
+
+    reader = xmlReaderForFile(fileName, NULL,
+                              ops->options | XML_PARSE_NOENT | XML_PARSE_NOBLANKS);
+    if (reader == NULL)
+        return 2;
+
+    memset(&st, 0, sizeof(st));
+    ret = xmlTextReaderRead(reader);
+    if (ret == 1)
+    {
+        enc = encoding;
+        if (enc == NULL)
+            enc = (const char *) xmlTextReaderConstEncoding(reader);
+        if (enc != NULL && (handler = xmlFindCharEncodingHandler(enc)) == NULL)
+        {
+            fprintf(stderr, "unknown encoding %s\n", enc);
+            xmlFreeTextReader(reader);
+            return EXIT_BAD_ARGS;
+        }
+
+        st.out = out? jobOutputBuffer(out, handler) :
+                      xmlOutputBufferCreateFd(fd, handler);
+        st.escape = (enc == NULL)? foEscapeEntities : NULL;
+        st.escapeDoc = xmlNewDoc(NULL);
+        st.escapeDoc->encoding = xmlStrdup(BAD_CAST enc);
+        st.scratch = xmlBufferCreate();
+        if (ops->indent)
+        {
+            char *indent = foIndentString(ops);
+            if (indent == NULL) indent = (char *) xmlStrdup(BAD_CAST "  ");
+            st.indent_size = strlen(indent);
+            st.indent_nr = FO_MAX_INDENT / st.indent_size;
+            for (i = 0; i < st.indent_nr; i++)
+                memcpy(st.indent + i * st.indent_size, indent, st.indent_size);
+            xmlFree(indent);
+        }
+
+        if (!ops->omit_decl)
+            foStreamDecl(&st, reader, enc);
+    }
+
+    while (ret == 1)
+    {
+        foStreamNode(ops, &st, reader);
+        ret = xmlTextReaderRead(reader);
+    }
+
+    if (ret != 0)
+        status = 2;
+    if (st.out != NULL)
+    {
+        if (xmlOutputBufferClose(st.out) < 0 && status == 0)
+            status = EXIT_LIB_ERROR;
+        xmlFreeDoc(st.escapeDoc);
+        xmlBufferFree(st.scratch);
+        xmlFree(st.format);
+    }
+    xmlFreeTextReader(reader);
+    return status;
+}
+#endif
+
+/* input is read in chunks of this size, grown for longer markup */
+#define FO_MINIFY_CHUNK (1 << 20)
+
+/* libxml2 passes text that needs normalizing in pieces of this size */
+#define FO_MINIFY_BUFFER 300
+
+/* what is known about the children of an open element */
+#define FO_MIN_CHILDREN   1   /* it has some */
+#define FO_MIN_FIRST_TEXT 2   /* the first one is text */
+#define FO_MIN_LAST_TEXT  4   /* the last one so far is text */
+#define FO_MIN_PRESERVE   8   /* xml:space="preserve" is in effect */
+#define FO_MIN_DEFAULT   16   /* xml:space="default" is in effect */
+#define FO_MIN_BLANKS    32   /* white space is kept from here on */
+
+/* xml:space applies to the descendants too */
+#define FO_MIN_INHERITED (FO_MIN_PRESERVE | FO_MIN_DEFAULT)
+
+typedef struct _foMinifyState {
+    foOptionsPtr ops;
+    xmlOutputBufferPtr out;
+    unsigned char *frames;    /* flags of the open elements */
+    int frames_size;
+    int depth;
+    int in_text;              /* inside character data */
+    int prolog;               /* no markup seen yet */
+} foMinifyState;
+
+/**
+ *  Find @seq (of @len bytes) in [@p, @end), returns the position after
+ *  it or NULL
+ */
+static const char *
+foFindSeq(const char *p, const char *end, const char *seq, int len)
+{
+    while ((p = memchr(p, seq[0], end - p)) != NULL)
+    {
+        if (end - p < len) return NULL;
+        if (!memcmp(p, seq, len)) return p + len;
+        p++;
+    }
+    return NULL;
+}
+
+/**
+ *  Find the end of the tag starting at @p, skipping quoted attribute
+ *  values; returns the position after the closing '>' or NULL
+ */
+static const char *
+foTagEnd(const char *p, const char *end)
+{
+    for (;;)
+    {
+        p = scanChr3(p, end, '>', '"', '\'');
+        if (p == end) return NULL;
+        if (*p == '>') return p + 1;
+        p = memchr(p + 1, *p, end - p - 1);
+        if (p == NULL) return NULL;
+        p++;
+    }
+}
+
+/**
+ *  Find the end of the markup declaration (DOCTYPE) starting at @p,
+ *  sets *@subset if it has an internal subset; returns the position
+ *  after the closing '>' or NULL
+ */
+static const char *
+foDeclEnd(const char *p, const char *end, int *subset)
+{
+    int brackets = 0;
+    char quote = 0;
+
+    *subset = 0;
+    for (; p < end; p++)
+    {
+        if (quote)
+        {
+            if (*p == quote) quote = 0;
+        }
+        else if (*p == '"' || *p == '\'')
+            quote = *p;
+        else if (*p == '[')
+            brackets++, *subset = 1;
+        else if (*p == ']')
+            brackets--;
+        else if (*p == '>' && brackets <= 0)
+            return p + 1;
+    }
+    return NULL;
+}
+
+/**
+ *  Can the input starting with [@p, @end) be minified byte by byte?
+ *  Not if it is compressed, not in an ASCII compatible encoding, or has
+ *  an internal DTD subset, which may declare entities and content models
+ *  that change what white space is significant.
+ */
+static int
+foMinifyBytewise(const char *p, const char *end)
+{
+    int subset;
+
+    if (end - p >= 2 &&
+        (p[0] == 0 || p[1] == 0 ||
+         ((unsigned char) p[0] == 0x1f && (unsigned char) p[1] == 0x8b) ||
+         ((unsigned char) p[0] == 0xfe && (unsigned char) p[1] == 0xff) ||
+         ((unsigned char) p[0] == 0xff && (unsigned char) p[1] == 0xfe)))
+        return 0;
+
+    /* look for the DOCTYPE in the prolog */
+    while ((p = scanSpace(p, end)) < end && *p == '<')
+    {
+        if (end - p >= 9 && !memcmp(p, "<!DOCTYPE", 9))
+        {
+            foDeclEnd(p, end, &subset);
+            return !subset;
+        }
+        if (end - p >= 4 && !memcmp(p, "<!--", 4))
+            p = foFindSeq(p + 4, end, "-->", 3);
+        else if (end - p >= 2 && p[1] == '?')
+            p = foFindSeq(p + 2, end, "?>", 2);
+        else
+            break;
+        if (p == NULL) break;
+    }
+    return 1;
+}
+
+/**
+ *  Note a child of the current element, @text or not
+ */
+static void
+foMinifyChild(foMinifyState *st, int text)
+{
+    unsigned char *frame;
+
+    if (st->depth == 0) return;
+    frame = &st->frames[st->depth - 1];
+    if (!(*frame & FO_MIN_CHILDREN))
+        *frame |= text? FO_MIN_CHILDREN | FO_MIN_FIRST_TEXT : FO_MIN_CHILDREN;
+    if (text)
+        *frame |= FO_MIN_LAST_TEXT;
+    else
+        *frame &= ~FO_MIN_LAST_TEXT;
+}
+
+/**
+ *  Note that the parser passed text in a piece starting with white space
+ *  to the current element: unless xml:space says otherwise, it keeps all
+ *  white space in the rest of the element then
+ */
+static void
+foMinifyBlanks(foMinifyState *st)
+{
+    unsigned char *frame;
+
+    if (st->depth == 0) return;
+    frame = &st->frames[st->depth - 1];
+    if (!(*frame & FO_MIN_INHERITED))
+        *frame |= FO_MIN_BLANKS;
+}
+
+/**
+ *  Is the run of white space before @next (pointing to '<') significant?
+ *  This follows the heuristic libxml2 applies without a DTD when blanks
+ *  are not kept: white space is kept where xml:space="preserve" applies,
+ *  as the only content of an element, next to text, and in the rest of
+ *  an element once the parser has passed some text in pieces that start
+ *  with white space (see foMinifyText()).
+ */
+static int
+foMinifyKeepBlanks(foMinifyState *st, const char *next, const char *end)
+{
+    unsigned char frame;
+
+    if (st->depth == 0) return 0;
+    frame = st->frames[st->depth - 1];
+    if (frame & (FO_MIN_PRESERVE | FO_MIN_BLANKS)) return 1;
+    if (!(frame & FO_MIN_CHILDREN)) return next + 1 < end && next[1] == '/';
+    return (frame & (FO_MIN_FIRST_TEXT | FO_MIN_LAST_TEXT)) != 0;
+}
+
+/**
+ *  Drop the pieces of the run of white space [@p, @q) that end at a
+ *  carriage return.  libxml2 normalizes line ends as it reads, so it
+ *  hands such a run over in pieces: up to every CR LF, which it treats
+ *  like markup following the piece, and then from the LF.  Once a bare
+ *  CR, or a CR LF followed by another CR or a non-ASCII character, is
+ *  reached, it passes everything up to the next markup or reference as
+ *  one piece, or in pieces of FO_MINIFY_BUFFER characters if it is
+ *  longer.  Unless the element has text next to them, the pieces ending
+ *  at a CR are dropped, and those ending at other white space (or at the
+ *  LF of a CR LF) are kept.
+ *  Returns where the rest of the run starts, and sets *@keep if that is
+ *  kept in any case.
+ */
+static const char *
+foMinifyLineEnds(foMinifyState *st, const char *p, const char *q,
+                 const char *end, int *keep)
+{
+    unsigned char frame = st->frames[st->depth - 1];
+    const char *r;
+    int len = 0;
+
+    *keep = 0;
+    if (frame & (FO_MIN_PRESERVE | FO_MIN_BLANKS |
+                 FO_MIN_FIRST_TEXT | FO_MIN_LAST_TEXT))
+        return p;
+
+    while ((r = memchr(p, '\r', q - p)) != NULL)
+    {
+        if (r + 1 < end && r[1] == '\n')
+        {
+            /* the next piece starts with the LF */
+            p = r + 1;
+            if (r + 2 < end && r[2] != '\r' && (unsigned char) r[2] < 0x80)
+                continue;
+        }
+        else
+            p = r;
+
+        /* the rest goes in pieces of normalized characters, each one
+           judged by the character that follows it */
+        for (r = p; r < q; r++)
+        {
+            if (r[0] == '\r' && r + 1 < end && r[1] == '\n') continue;
+            if (++len < FO_MINIFY_BUFFER || r + 1 >= q) continue;
+            /* the parser has moved past the CR of a CR LF already */
+            if (r[1] != '\r' || (r + 2 < end && r[2] == '\n'))
+            {
+                *keep = 1;
+                break;
+            }
+            p = r + 1;
+            len = 0;
+        }
+        break;
+    }
+    return p;
+}
+
+/**
+ *  Skip character data starting at @p, up to the next markup.  libxml2
+ *  hands text to the tree in pieces, split at references, carriage
+ *  returns and non-ASCII characters, and once a piece starting with white
+ *  space was found not to be blank, keeps all white space in the rest of
+ *  the element.  Returns the position where the text ends (or the chunk
+ *  ends, or a reference is cut off by the chunk end).
+ */
+static const char *
+foMinifyText(foMinifyState *st, const char *p, const char *end, int eof)
+{
+    unsigned char *frame = &st->frames[st->depth - 1];
+    const char *q;
+
+    while (!(*frame & (FO_MIN_INHERITED | FO_MIN_BLANKS)))
+    {
+        p = scanText(p, end);
+        if (p == end || *p == '<') return p;
+        if (*p == '&')
+        {
+            q = memchr(p, ';', end - p);
+            if (q == NULL || q + 1 >= end)
+                return eof? end : p;
+            if (SCAN_IS_SPACE(q[1]))
+                foMinifyBlanks(st);
+            p = q + 1;
+        }
+        else
+            foMinifyBlanks(st);
+    }
+
+    q = memchr(p, '<', end - p);
+    return q? q : end;
+}
+
+/**
+ *  Open the element whose start tag is [@p, @end)
+ */
+static void
+foMinifyStartElement(foMinifyState *st, const char *p, const char *end)
+{
+    unsigned char frame = 0;
+    const char *attr;
+
+    if (st->depth > 0)
+        frame = st->frames[st->depth - 1] & FO_MIN_INHERITED;
+    attr = foFindSeq(p, end, "xml:space", 9);
+    if (attr != NULL)
+    {
+        attr = scanChr2(attr, end, '"', '\'');
+        if (end - attr > 9 && !memcmp(attr + 1, "preserve", 8))
+            frame = FO_MIN_PRESERVE;
+        else if (end - attr > 8 && !memcmp(attr + 1, "default", 7))
+            frame = FO_MIN_DEFAULT;
+    }
+
+    if (st->depth >= st->frames_size)
+    {
+        st->frames_size = (st->depth + 1) * 2;
+        st->frames = xmlRealloc(st->frames, st->frames_size);
+    }
+    st->frames[st->depth++] = frame;
+}
+
+/**
+ *  Move the kept input [@from, @to) down to @dst, returns its new end
+ */
+static char *
+foMinifyKeep(char *dst, const char *from, const char *to)
+{
+    if (dst != from)
+        memmove(dst, from, to - from);
+    return dst + (to - from);
+}
+
+/**
+ *  Minify the complete markup and text in [@buf, @end), @eof tells if
+ *  the input ends there; returns the number of bytes consumed (the rest
+ *  has to be passed again with more input), or -1 if the input ends in
+ *  the middle of markup.  What is kept is moved together in the buffer
+ *  and written out in one piece.
+ */
+static int
+foMinifyChunk(foMinifyState *st, char *buf, const char *end, int eof)
+{
+    const char *p = buf, *span = buf, *q;
+    char *dst = buf, *flushed = buf;
+    int subset;
+
+    while (p < end)
+    {
+        if (st->in_text)
+        {
+            if (st->depth == 0)
+                q = memchr(p, '<', end - p);
+            else
+                q = foMinifyText(st, p, end, eof);
+            if (q == NULL || q == end || *q != '<')
+            {
+                p = q? q : end;
+                break;
+            }
+            p = q;
+            st->in_text = 0;
+        }
+        else if (*p != '<')
+        {
+            int keep = 0;
+
+            q = scanSpace(p, end);
+            if (q + 1 >= end && !eof) break;      /* can not tell yet */
+            if (st->depth > 0 && memchr(p, '\r', q - p) != NULL)
+            {
+                const char *rest = foMinifyLineEnds(st, p, q, end, &keep);
+                dst = foMinifyKeep(dst, span, p);
+                span = p = rest;
+            }
+            if (q < end && *q != '<')
+            {
+                st->in_text = 1;
+                foMinifyChild(st, 1);
+                if (q > p) foMinifyBlanks(st);
+            }
+            else if (q < end && (keep || foMinifyKeepBlanks(st, q, end)))
+            {
+                foMinifyChild(st, 1);
+                foMinifyBlanks(st);
+            }
+            else
+            {
+                dst = foMinifyKeep(dst, span, p);
+                span = q;
+            }
+            p = q;
+        }
+        else
+        {
+            /* markup: find its end */
+            int top = 0;
+
+            if (end - p < 9 && !eof) break;
+            if (st->prolog)
+            {
+                st->prolog = 0;
+                if (end - p >= 6 && !memcmp(p, "<?xml", 5) &&
+                    SCAN_IS_SPACE(p[5]))
+                {
+                    q = foFindSeq(p + 5, end, "?>", 2);
+                    if (q == NULL) goto incomplete;
+                    if (!st->ops->omit_decl)
+                    {
+                        dst = foMinifyKeep(dst, span, q);
+                        xmlOutputBufferWrite(st->out, dst - flushed, flushed);
+                        xmlOutputBufferWrite(st->out, 1, "\n");
+                        flushed = dst;
+                    }
+                    span = q;
+                    p = q;
+                    continue;
+                }
+                if (!st->ops->omit_decl)
+                {
+                    dst = foMinifyKeep(dst, span, p);
+                    xmlOutputBufferWrite(st->out, dst - flushed, flushed);
+                    xmlOutputBufferWriteString(st->out,
+                                               "<?xml version=\"1.0\"?>\n");
+                    flushed = dst;
+                    span = p;
+                }
+            }
+
+            if (p[1] == '/')
+            {
+                q = memchr(p, '>', end - p);
+                if (q == NULL) goto incomplete;
+                q++;
+                if (st->depth > 0) st->depth--;
+                top = st->depth == 0;
+            }
+            else if (p[1] == '!' && end - p >= 4 && !memcmp(p, "<!--", 4))
+            {
+                q = foFindSeq(p + 4, end, "-->", 3);
+                if (q == NULL) goto incomplete;
+                foMinifyChild(st, 0);
+                top = st->depth == 0;
+            }
+            else if (p[1] == '!' && end - p >= 9 && !memcmp(p, "<![CDATA[", 9))
+            {
+                q = foFindSeq(p + 9, end, "]]>", 3);
+                if (q == NULL) goto incomplete;
+                foMinifyChild(st, 0);
+            }
+            else if (p[1] == '!')
+            {
+                q = foDeclEnd(p, end, &subset);
+                if (q == NULL) goto incomplete;
+                if (st->ops->dropdtd)
+                {
+                    dst = foMinifyKeep(dst, span, p);
+                    span = p = q;
+                    continue;
+                }
+                top = 1;
+            }
+            else if (p[1] == '?')
+            {
+                q = foFindSeq(p + 2, end, "?>", 2);
+                if (q == NULL) goto incomplete;
+                foMinifyChild(st, 0);
+                top = st->depth == 0;
+            }
+            else
+            {
+                q = foTagEnd(p + 1, end);
+                if (q == NULL) goto incomplete;
+                foMinifyChild(st, 0);
+                if (q[-2] == '/')
+                    top = st->depth == 0;
+                else
+                    foMinifyStartElement(st, p, q);
+            }
+
+            if (top)
+            {
+                /* top level nodes are written on lines of their own */
+                dst = foMinifyKeep(dst, span, q);
+                xmlOutputBufferWrite(st->out, dst - flushed, flushed);
+                xmlOutputBufferWrite(st->out, 1, "\n");
+                flushed = dst;
+                span = q;
+            }
+            p = q;
+        }
+    }
+
+    dst = foMinifyKeep(dst, span, p);
+    xmlOutputBufferWrite(st->out, dst - flushed, flushed);
+    return p - buf;
+
+incomplete:
+    dst = foMinifyKeep(dst, span, p);
+    xmlOutputBufferWrite(st->out, dst - flushed, flushed);
+    return eof? -1 : p - buf;
+}
+
+/*
+ *  Input for the tree parser when a document turns out not to be fit
+ *  for minifying byte by byte: what was read already, then the rest
+ */
+typedef struct _foMinifyInput {
+    const char *buf;
+    int len;
+    FILE *file;
+} foMinifyInput;
+
+static int
+foMinifyRead(void *context, char *buffer, int len)
+{
+    foMinifyInput *input = context;
+
+    if (input->len > 0)
+    {
+        if (len > input->len) len = input->len;
+        memcpy(buffer, input->buf, len);
+        input->buf += len;
+        input->len -= len;
+        return len;
+    }
+    return fread(buffer, 1, len, input->file);
+}
+
+/**
+ *  Strip the insignificant white space from @fileName without building
+ *  a tree: the input is copied through as it is, except for the runs of
+ *  white space between markup that the tree parser would drop.  The
+ *  markup is only delimited here; a push parser without callbacks reads
+ *  the input alongside to check that it is well-formed.  Documents this
+ *  can not be done for are parsed into *@tree instead.
+ */
+static int
+foMinify(foOptionsPtr ops, const char *fileName, int fd, xmlBufferPtr out,
+         xmlDocPtr *tree)
+{
+    foMinifyState st;
+    xmlSAXHandler sax;
+    xmlParserCtxtPtr check;
+    FILE *file = stdin;
+    char *buf;
+    int size = FO_MINIFY_CHUNK, len = 0, start = 0, eof = 0, ret = 0;
+    int truncated = 0, n;
+
+    if (strcmp(fileName, "-"))
+    {
+        file = fopen(fileName, "rb");
+        if (file == NULL)
+        {
+            fprintf(stderr, "error: could not open: %s\n", fileName);
+            return 2;
+        }
+    }
+
+    buf = xmlMalloc(size);
+    len = fread(buf, 1, size, file);
+    eof = feof(file) || ferror(file);
+    if (!foMinifyBytewise(buf, buf + len))
+    {
+        foMinifyInput input;
+
+        input.buf = buf;
+        input.len = len;
+        input.file = file;
+        *tree = xmlReadIO(foMinifyRead, NULL, &input, fileName, NULL,
+                          ops->options | XML_PARSE_NOENT | XML_PARSE_NOBLANKS);
+        if (*tree == NULL) ret = 2;
+        goto done;
+    }
+    /* no byte order mark in the output */
+    if (len >= 3 && !memcmp(buf, "\xEF\xBB\xBF", 3))
+        start = 3;
+
+    memset(&sax, 0, sizeof(sax));
+    sax.initialized = XML_SAX2_MAGIC;
+    check = xmlCreatePushParserCtxt(&sax, NULL, NULL, 0, fileName);
+    if (check == NULL)
+    {
+        ret = EXIT_LIB_ERROR;
+        goto done;
+    }
+    xmlCtxtUseOptions(check, ops->options);
+    xmlParseChunk(check, buf, len, eof);
+
+    memset(&st, 0, sizeof(st));
+    st.ops = ops;
+    st.out = out? jobOutputBuffer(out, NULL) : xmlOutputBufferCreateFd(fd, NULL);
+    st.prolog = 1;
+
+    for (;;)
+    {
+        int used = foMinifyChunk(&st, buf + start, buf + len, eof);
+
+        if (used < 0)
+        {
+            truncated = 1;
+            break;
+        }
+        start += used;
+        if (eof) break;
+
+        /* keep the unfinished markup, and make room for more */
+        len -= start;
+        memmove(buf, buf + start, len);
+        start = 0;
+        if (len == size)
+        {
+            size *= 2;
+            buf = xmlRealloc(buf, size);
+        }
+        n = fread(buf + len, 1, size - len, file);
+        eof = feof(file) || ferror(file);
+        xmlParseChunk(check, buf + len, n, eof);
+        len += n;
+    }
+
+    /* the parser has reported what is wrong with the input */
+    if (!check->wellFormed)
+        ret = 2;
+    else if (truncated || st.depth > 0)
+    {
+        fprintf(stderr, "%s: premature end of data\n", fileName);
+        ret = 2;
+    }
+    xmlFreeParserCtxt(check);
+
+    if (xmlOutputBufferClose(st.out) < 0 && ret == 0)
+        ret = EXIT_LIB_ERROR;
+    xmlFree(st.frames);
+
+done:
+    xmlFree(buf);
+    if (file != stdin) fclose(file);
+    return ret;
+}
+
+/**
+ *  'process' xml document @fileName, the result is written to @out
+ *  if it is not NULL, to file descriptor @fd otherwise
  */
 int
-foProcess(foOptionsPtr ops, int start, int argc, char **argv)
+foProcess(foOptionsPtr ops, const char *fileName, int fd, xmlBufferPtr out)
 {
     int ret = 0;
     xmlDocPtr doc = NULL;
-    char *fileName = "-";
     char *spaces = NULL;
     const char *indent = NULL;
     xmlSaveCtxt *save;
     const char *save_enc;
     int save_opts;
 
-    if ((start > 1) && (start < argc) && (argv[start][0] != '-') &&
-        strcmp(argv[start-1], "--indent-spaces") &&
-        strcmp(argv[start-1], "-s"))
-    {
-        fileName = argv[start];   
-    }
 /*
     if (ops->recovery)
     {
@@ -239,18 +1283,35 @@ foProcess(foOptionsPtr ops, int start, int argc, char **argv)
     }
     else    
 */
-    if (ops->quiet)
-        suppressErrors();
-
-#ifdef LIBXML_HTML_ENABLED
-    if (ops->html)
+    if (ops->minify)
     {
-        doc = readHtml(fileName, XML_PARSE_NOBLANKS);
+        /* options that need the tree are handled by the tree path */
+        int bytewise = encoding == NULL && !ops->recovery &&
+            !(ops->options & (XML_PARSE_NOCDATA | XML_PARSE_NSCLEAN));
+#ifdef LIBXML_HTML_ENABLED
+        if (ops->html) bytewise = 0;
+#endif
+        if (bytewise)
+        {
+            ret = foMinify(ops, fileName, fd, out, &doc);
+            if (doc == NULL) return ret;
+        }
     }
-    else
+#ifdef FO_STREAM
+    else if (ops->stream)
+        return foStream(ops, fileName, fd, out);
+#endif
+
+    if (doc == NULL)
+    {
+#ifdef LIBXML_HTML_ENABLED
+        if (ops->html)
+            doc = readHtml(fileName, XML_PARSE_NOBLANKS);
+        else
 #endif
-        doc = readXml(fileName,
-                      ops->options | XML_PARSE_NOENT | XML_PARSE_NOBLANKS);
+            doc = readXml(fileName,
+                          ops->options | XML_PARSE_NOENT | XML_PARSE_NOBLANKS);
+    }
 
     if (doc == NULL)
     {
@@ -271,22 +1332,13 @@ foProcess(foOptionsPtr ops, int start, int argc, char **argv)
         }
     }
 
-    save_opts = XML_SAVE_FORMAT;
+    save_opts = ops->minify? 0 : XML_SAVE_FORMAT;
     if (ops->omit_decl)
         save_opts |= XML_SAVE_NO_DECL;
 
     if (ops->indent) {
-        if (ops->indent_tab)
-        {
-            indent = "\t";
-        }
-        else if (ops->indent_spaces > 0)
-        {
-            spaces = xmlMalloc(ops->indent_spaces + 1);
-            indent = spaces;
-            memset(spaces, ' ', ops->indent_spaces);
-            spaces[ops->indent_spaces] = '\0';
-        }
+        spaces = foIndentString(ops);
+        indent = spaces;
 #if LIBXML_VERSION >= 21400
         save_opts |= XML_SAVE_INDENT;
 #else
@@ -306,36 +1358,152 @@ foProcess(foOptionsPtr ops, int start, int argc, char **argv)
         save_enc = encoding;
     else
         save_enc = (const char *) doc->encoding;
-    save = xmlSaveToFd(/* STDOUT_FILENO */ 1, save_enc, save_opts);
+    if (out)
+        save = xmlSaveToBuffer(out, save_enc, save_opts);
+    else
+        save = xmlSaveToFd(fd, save_enc, save_opts);
 
 #if LIBXML_VERSION >= 21400
     if (indent != NULL)
         xmlSaveSetIndentString(save, indent);
 #endif
 
-    xmlSaveDoc(save, doc);
-    xmlSaveClose(save);
+    if (xmlSaveDoc(save, doc) < 0 || xmlSaveClose(save) < 0)
+        ret = EXIT_LIB_ERROR;
 
-    free(spaces);
+    xmlFree(spaces);
     xmlFreeDoc(doc);
     return ret;
 }
 
+/**
+ *  Format @fileName in place: the result goes to a temporary file next
+ *  to it, which replaces the original only once it is complete
+ */
+static int
+foProcessInPlace(foOptionsPtr ops, const char *fileName)
+{
+    char *tmpName;
+    int fd, ret;
+#ifdef HAVE_STAT
+    struct stat st;
+#endif
+
+    tmpName = xmlMalloc(strlen(fileName) + 8);
+    sprintf(tmpName, "%s.XXXXXX", fileName);
+#ifdef HAVE_MKSTEMP
+    fd = mkstemp(tmpName);
+#else
+    fd = open(mktemp(tmpName), O_WRONLY | O_CREAT | O_EXCL, 0600);
+#endif
+    if (fd < 0)
+    {
+        fprintf(stderr, "unable to create %s\n", tmpName);
+        xmlFree(tmpName);
+        return EXIT_LIB_ERROR;
+    }
+
+    ret = foProcess(ops, fileName, fd, NULL);
+    if (close(fd) != 0 && ret == 0)
+        ret = EXIT_LIB_ERROR;
+#ifdef HAVE_STAT
+    if (ret == 0 && stat(fileName, &st) == 0)
+        chmod(tmpName, st.st_mode & 07777);
+#endif
+#ifdef _WIN32
+    if (ret == 0)
+        remove(fileName);
+#endif
+    if (ret == 0 && rename(tmpName, fileName) != 0)
+    {
+        fprintf(stderr, "unable to replace %s\n", fileName);
+        ret = EXIT_LIB_ERROR;
+    }
+    if (ret != 0)
+        unlink(tmpName);
+
+    xmlFree(tmpName);
+    return ret;
+}
+
+/*
+ *  Formatting of the command line files, shared by the jobs
+ */
+typedef struct _foJob {
+    foOptionsPtr ops;
+    char **files;
+    int status;
+} foJob;
+
+static int
+foRunFile(void *shared, void *local, int item, xmlBufferPtr out)
+{
+    foJob *job = shared;
+
+    if (job->ops->inplace)
+        return foProcessInPlace(job->ops, job->files[item]);
+    return foProcess(job->ops, job->files[item],
+                     /* STDOUT_FILENO */ 1, out);
+}
+
+static void
+foDoneFile(void *shared, int item, int status, xmlBufferPtr out)
+{
+    foJob *job = shared;
+
+    if (out)
+        fwrite(xmlBufferContent(out), 1, xmlBufferLength(out), stdout);
+    if (status) job->status = status;
+}
+
 /**
  *  This is the main function for 'format' option
  */
 int
 foMain(int argc, char **argv)
 {
-    int ret = 0;
+    static const jobHandlers foHandlers =
+        { NULL, foRunFile, foDoneFile, NULL };
+    static char *stdinFiles[] = { "-" };
     int start;
     static foOptions ops;
+    foJob job;
 
     if (argc <=1) foUsage(argc, argv, EXIT_BAD_ARGS);
     foInitOptions(&ops);
     start = foParseOptions(&ops, argc, argv);
-    if (argc-start > 1) foUsage(argc, argv, EXIT_BAD_ARGS);
-    ret = foProcess(&ops, start, argc, argv);
-    
-    return ret;
+#if defined(FO_STREAM) && defined(LIBXML_HTML_ENABLED)
+    /* xmlTextReader can not read HTML */
+    if (ops.stream && ops.html) foUsage(argc, argv, EXIT_BAD_ARGS);
+#endif
+
+    job.ops = &ops;
+    job.status = 0;
+    if ((start > 1) && (start < argc) && (argv[start][0] != '-') &&
+        strcmp(argv[start-1], "--indent-spaces") &&
+        strcmp(argv[start-1], "-s"))
+    {
+        int i;
+
+        /* options must come before the files */
+        for (i = start + 1; i < argc; i++)
+            if (argv[i][0] == '-' && argv[i][1])
+                foUsage(argc, argv, EXIT_BAD_ARGS);
+        job.files = argv + start;
+    }
+    else
+    {
+        /* there is nothing to replace when formatting stdin */
+        if (ops.inplace) foUsage(argc, argv, EXIT_BAD_ARGS);
+        job.files = stdinFiles;
+        start = argc - 1;
+    }
+
+    /* worker threads inherit the error handlers */
+    if (ops.quiet)
+        suppressErrors();
+
+    runJobs(ops.jobs, argc - start, &job, &foHandlers);
+
+    return job.status;
 }
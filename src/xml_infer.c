@@ -0,0 +1,1588 @@
+/*  $Id: xml_elem.c,v 1.23 2004/11/21 23:40:40 mgrouch Exp $  */
+
+/*
+
+XMLStarlet: Command Line Toolkit to query/edit/check/transform XML documents
+
+Copyright (c) 2002-2004 Mikhail Grushinskiy.  All Rights Reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+#include <config.h>
+
+#include <libxml/xmlreader.h>
+#include <libxml/hash.h>
+#include <libxml/dict.h>
+#include <libxml/entities.h>
+#include <libxml/parserInternals.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "xmlstar.h"
+#include "jobs.h"
+
+/*
+ *  Guess a schema from instance documents.  The documents are read with
+ *  the same reader walk as 'el', and every element name gets a summary:
+ *  the children it had and how often, whether they came in a fixed order,
+ *  its attributes and what its text and attribute values look like.
+ *  Summaries only grow with the number of distinct names, not with the
+ *  size or number of the documents, and the summaries of different
+ *  workers are merged by adding them up.
+ */
+
+#define INFER_MAX_ENUM 8        /* most distinct values of an enumeration */
+#define INFER_ENUM_REPEAT 2     /* values needed per enumerated value */
+#define INFER_MAX_VALUE 64      /* longer values are just strings */
+
+/* the namespace of namespace declarations, as the reader reports it */
+#define INFER_XMLNS_NAMESPACE BAD_CAST "http://www.w3.org/2000/xmlns/"
+
+/* what every value seen so far looks like */
+#define INFER_INT       1
+#define INFER_DECIMAL   2
+#define INFER_DATE      4
+#define INFER_NMTOKEN   8
+#define INFER_ALL_TYPES 15
+
+typedef enum {
+    INFER_XSD,
+    INFER_DTD,
+    INFER_RNG
+} inferFormat;
+
+/* the type a summary of values comes down to */
+typedef enum {
+    INFER_STRING,
+    INFER_ENUMERATION,
+    INFER_INTEGER,
+    INFER_DECIMALS,
+    INFER_DATES
+} inferKind;
+
+typedef struct _inferOptions {
+    inferFormat format;
+    int jobs;                 /* number of files to read in parallel */
+    const char *files_from;   /* file with names of more input files */
+} inferOptions;
+
+/* where something was seen first, to print it in document order */
+typedef struct _inferOrder {
+    int file;
+    unsigned long seq;
+} inferOrder;
+
+typedef struct _inferValues {
+    unsigned long count;      /* number of values */
+    int types;                /* INFER_* flags that all values have */
+    int nenum;                /* distinct values, -1 if too many */
+    xmlChar *enums[INFER_MAX_ENUM];
+} inferValues;
+
+typedef struct _inferElement inferElement;
+
+typedef struct _inferChild {
+    inferElement *element;
+    int min, max;             /* occurrences in one parent, min -1 if unknown */
+    inferOrder first;
+} inferChild;
+
+typedef struct _inferAttr {
+    const xmlChar *name;
+    const xmlChar *href;      /* namespace URI or NULL, INFER_XMLNS_NAMESPACE
+                                 for a namespace declaration */
+    unsigned long count;      /* number of elements with the attribute */
+    inferValues values;
+    inferOrder first;
+} inferAttr;
+
+struct _inferElement {
+    const xmlChar *name;      /* qualified name, as written */
+    const xmlChar *href;      /* namespace URI or NULL */
+    unsigned long count;      /* number of instances */
+    unsigned long done;       /* instances read up to their end */
+    unsigned long roots;      /* instances that were the document element */
+    unsigned long empty;      /* instances without children or text */
+    int mixed;                /* an instance had both children and text */
+    int unordered;            /* a child came back after another one */
+    inferValues values;       /* text of instances without children */
+    inferChild *children;
+    int nchildren, maxchildren;
+    unsigned char *follows;   /* follows[i * maxchildren + j]: child j came
+                                 right after child i */
+    inferAttr *attrs;
+    int nattrs, maxattrs;
+    int nsdecls;              /* attrs that are namespace declarations, these
+                                 come last once the attrs are sorted */
+    inferOrder first;
+};
+
+typedef struct _inferSummary {
+    xmlHashTablePtr elements; /* inferElement by name */
+    xmlDictPtr dict;          /* names, NULL if they are the reader's */
+} inferSummary;
+
+/* an element being read */
+typedef struct _inferFrame {
+    inferElement *element;
+    int *counts;              /* occurrences of each child so far */
+    int size;                 /* of counts */
+    int used;                 /* counts set to 0 up to here */
+    int last;                 /* index of the last child, -1 if none */
+    int children;             /* number of child elements */
+    int text;                 /* had some text */
+    int length;               /* of value, -1 if longer than INFER_MAX_VALUE */
+    xmlChar value[INFER_MAX_VALUE + 1];
+} inferFrame;
+
+/* a worker */
+typedef struct _inferState {
+    xmlTextReaderPtr reader;  /* reused, so all files share its dictionary */
+    inferSummary summary;
+    inferFrame *frames;
+    int nframes;
+    unsigned long seq;
+} inferState;
+
+/* all input files, for the job handlers */
+typedef struct _inferJob {
+    char **files;
+    int nfiles;
+    inferSummary summary;     /* of all files */
+    int status;
+} inferJob;
+
+static inferOptions inferOps;
+
+/**
+ *  Display usage syntax
+ */
+static void
+inferUsage(int argc, char **argv, exit_status status)
+{
+    extern void fprint_infer_usage(FILE* o, const char* argv0);
+    extern const char more_info[];
+    FILE *o = (status == EXIT_SUCCESS)? stdout : stderr;
+    fprint_infer_usage(o, argv[0]);
+    fprintf(o, "%s", more_info);
+    exit(status);
+}
+
+static void
+inferOutOfMemory(void *ptr)
+{
+    if (ptr) return;
+    fprintf(stderr, "out of memory\n");
+    exit(EXIT_INTERNAL_ERROR);
+}
+
+static int
+inferOrderCompare(const inferOrder *o1, const inferOrder *o2)
+{
+    if (o1->file != o2->file) return o1->file < o2->file? -1 : 1;
+    if (o1->seq != o2->seq) return o1->seq < o2->seq? -1 : 1;
+    return 0;
+}
+
+static int
+inferDigits(const xmlChar *p, int n)
+{
+    while (n--)
+    {
+        if (*p < '0' || *p > '9') return 0;
+        p++;
+    }
+    return 1;
+}
+
+/**
+ *  Get the INFER_* flags of a @value of @len bytes, without leading or
+ *  trailing white space
+ */
+static int
+inferValueTypes(const xmlChar *value, int len)
+{
+    xmlChar token[INFER_MAX_VALUE + 1];
+    const xmlChar *p = value, *end = value + len;
+    int types = 0, digits = 0, point = 0;
+
+    /* [+-]?digits or [+-]?digits.digits with digits on either side */
+    if (p < end && (*p == '+' || *p == '-')) p++;
+    for (; p < end; p++)
+    {
+        if (*p >= '0' && *p <= '9') digits++;
+        else if (*p == '.' && !point) point = 1;
+        else break;
+    }
+    if (p == end && digits > 0)
+        types |= point? INFER_DECIMAL : INFER_INT | INFER_DECIMAL;
+
+    /* YYYY-MM-DD with an optional time zone */
+    if (len >= 10 && inferDigits(value, 4) && value[4] == '-' &&
+        inferDigits(value + 5, 2) && value[7] == '-' &&
+        inferDigits(value + 8, 2) &&
+        xmlStrncmp(value + 5, BAD_CAST "01", 2) >= 0 &&
+        xmlStrncmp(value + 5, BAD_CAST "12", 2) <= 0 &&
+        xmlStrncmp(value + 8, BAD_CAST "01", 2) >= 0 &&
+        xmlStrncmp(value + 8, BAD_CAST "31", 2) <= 0)
+    {
+        p = value + 10;
+        if (p < end && *p == 'Z') p++;
+        else if (end - p == 6 && (*p == '+' || *p == '-') &&
+                 inferDigits(p + 1, 2) && p[3] == ':' && inferDigits(p + 4, 2))
+            p += 6;
+        if (p == end) types |= INFER_DATE;
+    }
+
+    memcpy(token, value, len);
+    token[len] = '\0';
+    if (len > 0 && xmlValidateNMToken(token, 0) == 0)
+        types |= INFER_NMTOKEN;
+
+    return types;
+}
+
+static void
+inferValuesInit(inferValues *values)
+{
+    values->count = 0;
+    values->types = INFER_ALL_TYPES;
+    values->nenum = 0;
+}
+
+static void
+inferValuesFree(inferValues *values)
+{
+    int i;
+    for (i = 0; i < values->nenum; i++)
+        xmlFree(values->enums[i]);
+    values->nenum = -1;
+}
+
+/**
+ *  Add a distinct value to the enumeration of @values
+ */
+static void
+inferAddEnum(inferValues *values, const xmlChar *value, int len)
+{
+    int i;
+
+    if (values->nenum < 0) return;
+    for (i = 0; i < values->nenum; i++)
+    {
+        if (!xmlStrncmp(values->enums[i], value, len) &&
+            values->enums[i][len] == '\0')
+            return;
+    }
+    if (values->nenum == INFER_MAX_ENUM)
+    {
+        inferValuesFree(values);
+        return;
+    }
+    values->enums[values->nenum] = xmlStrndup(value, len);
+    inferOutOfMemory(values->enums[values->nenum]);
+    values->nenum++;
+}
+
+/**
+ *  Add @value of @len bytes to @values; @len is -1 for a value that
+ *  was too long to keep
+ */
+static void
+inferAddValue(inferValues *values, const xmlChar *value, int len)
+{
+    values->count++;
+    if (len < 0 || len > INFER_MAX_VALUE)
+    {
+        values->types = 0;
+        inferValuesFree(values);
+        return;
+    }
+
+    while (len > 0 && IS_BLANK_CH(*value))
+    {
+        value++;
+        len--;
+    }
+    while (len > 0 && IS_BLANK_CH(value[len - 1]))
+        len--;
+
+    values->types &= inferValueTypes(value, len);
+    inferAddEnum(values, value, len);
+}
+
+static void
+inferMergeValues(inferValues *dst, inferValues *src)
+{
+    int i;
+
+    dst->count += src->count;
+    dst->types &= src->types;
+    if (src->nenum < 0)
+        inferValuesFree(dst);
+    for (i = 0; i < src->nenum; i++)
+        inferAddEnum(dst, src->enums[i], xmlStrlen(src->enums[i]));
+}
+
+static int
+compare_enum(const void *p1, const void *p2)
+{
+    typedef xmlChar const *const xmlCChar;
+    xmlCChar *str1 = p1, *str2 = p2;
+    return xmlStrcmp(*str1, *str2);
+}
+
+/**
+ *  Decide what type the values are, sorts the enumerated values;
+ *  @empty is set if there were instances without a value
+ */
+static inferKind
+inferValueKind(inferValues *values, int empty)
+{
+    if (values->count == 0 || empty) return INFER_STRING;
+    if (values->types & INFER_INT) return INFER_INTEGER;
+    if (values->types & INFER_DECIMAL) return INFER_DECIMALS;
+    if (values->types & INFER_DATE) return INFER_DATES;
+    if (values->nenum > 0 &&
+        values->count >= (unsigned long) values->nenum * INFER_ENUM_REPEAT)
+    {
+        qsort(values->enums, values->nenum, sizeof(xmlChar *), compare_enum);
+        return INFER_ENUMERATION;
+    }
+    return INFER_STRING;
+}
+
+/**
+ *  Get the summary of elements named @name, creating it if there is
+ *  none yet; @name must stay around as long as @summary
+ */
+static inferElement *
+inferGetElement(inferSummary *summary, const xmlChar *name,
+                const xmlChar *href, const inferOrder *first)
+{
+    inferElement *element = xmlHashLookup(summary->elements, name);
+
+    if (element) return element;
+
+    element = xmlMalloc(sizeof(inferElement));
+    inferOutOfMemory(element);
+    memset(element, 0, sizeof(inferElement));
+    element->name = name;
+    element->href = href;
+    inferValuesInit(&element->values);
+    element->first = *first;
+    xmlHashAddEntry(summary->elements, name, element);
+    return element;
+}
+
+/**
+ *  Get the index of @child among the children of @element, adding it
+ *  if it is new
+ */
+static int
+inferAddChild(inferElement *element, inferElement *child,
+              const inferOrder *first)
+{
+    inferChild *entry;
+    int i;
+
+    for (i = 0; i < element->nchildren; i++)
+        if (element->children[i].element == child) return i;
+
+    if (element->nchildren == element->maxchildren)
+    {
+        int size = element->maxchildren? element->maxchildren * 2 : 8;
+        unsigned char *follows = xmlMalloc(size * size);
+
+        inferOutOfMemory(follows);
+        memset(follows, 0, size * size);
+        for (i = 0; i < element->nchildren; i++)
+            memcpy(follows + i * size,
+                   element->follows + i * element->maxchildren,
+                   element->nchildren);
+        xmlFree(element->follows);
+        element->follows = follows;
+        element->children = xmlRealloc(element->children,
+                                       size * sizeof(inferChild));
+        inferOutOfMemory(element->children);
+        element->maxchildren = size;
+    }
+
+    entry = &element->children[element->nchildren];
+    entry->element = child;
+    /* instances that already ended did not have it */
+    entry->min = element->done > 0? 0 : -1;
+    entry->max = 0;
+    entry->first = *first;
+    return element->nchildren++;
+}
+
+static int
+inferIsNsDecl(const xmlChar *href)
+{
+    return href && xmlStrEqual(href, INFER_XMLNS_NAMESPACE);
+}
+
+/**
+ *  Get the summary of attribute @name of @element, adding it if it is new
+ */
+static inferAttr *
+inferGetAttr(inferElement *element, const xmlChar *name,
+             const xmlChar *href, const inferOrder *first)
+{
+    inferAttr *attr;
+    int i;
+
+    for (i = 0; i < element->nattrs; i++)
+        if (element->attrs[i].name == name) return &element->attrs[i];
+    for (i = 0; i < element->nattrs; i++)
+        if (xmlStrEqual(element->attrs[i].name, name)) return &element->attrs[i];
+
+    if (element->nattrs == element->maxattrs)
+    {
+        element->maxattrs = element->maxattrs? element->maxattrs * 2 : 4;
+        element->attrs = xmlRealloc(element->attrs,
+                                    element->maxattrs * sizeof(inferAttr));
+        inferOutOfMemory(element->attrs);
+    }
+    attr = &element->attrs[element->nattrs++];
+    attr->name = name;
+    attr->href = href;
+    attr->count = 0;
+    if (inferIsNsDecl(href)) element->nsdecls++;
+    inferValuesInit(&attr->values);
+    attr->first = *first;
+    return attr;
+}
+
+static void
+inferSummaryInit(inferSummary *summary, xmlDictPtr dict)
+{
+    summary->elements = xmlHashCreate(0);
+    summary->dict = dict;
+    inferOutOfMemory(summary->elements);
+}
+
+static void
+inferFreeElement(void *payload, const xmlChar *name)
+{
+    inferElement *element = payload;
+    int i;
+
+    for (i = 0; i < element->nattrs; i++)
+        inferValuesFree(&element->attrs[i].values);
+    inferValuesFree(&element->values);
+    xmlFree(element->attrs);
+    xmlFree(element->children);
+    xmlFree(element->follows);
+    xmlFree(element);
+}
+
+static void
+inferSummaryFree(inferSummary *summary)
+{
+    xmlHashFree(summary->elements, inferFreeElement);
+    if (summary->dict) xmlDictFree(summary->dict);
+}
+
+/*
+ *  Reading documents
+ */
+
+/**
+ *  Get the frame for an element at @depth, with counts for at least
+ *  @children children
+ */
+static inferFrame *
+inferGetFrame(inferState *state, int depth)
+{
+    if (depth >= state->nframes)
+    {
+        int size = state->nframes? state->nframes * 2 : 32;
+        state->frames = xmlRealloc(state->frames, size * sizeof(inferFrame));
+        inferOutOfMemory(state->frames);
+        memset(state->frames + state->nframes, 0,
+               (size - state->nframes) * sizeof(inferFrame));
+        state->nframes = size;
+    }
+    return &state->frames[depth];
+}
+
+/**
+ *  Make sure @frame has counts up to child @index, set to 0
+ */
+static void
+inferFrameCounts(inferFrame *frame, int index)
+{
+    if (index < frame->used) return;
+    if (index >= frame->size)
+    {
+        frame->size = index < 8? 16 : index * 2;
+        frame->counts = xmlRealloc(frame->counts, frame->size * sizeof(int));
+        inferOutOfMemory(frame->counts);
+    }
+    memset(frame->counts + frame->used, 0,
+           (index + 1 - frame->used) * sizeof(int));
+    frame->used = index + 1;
+}
+
+/**
+ *  The reader is at the start of an element at @depth of input @file
+ */
+static void
+inferStartElement(inferState *state, int depth, int file)
+{
+    xmlTextReaderPtr reader = state->reader;
+    const xmlChar *name = xmlTextReaderConstName(reader);
+    inferElement *element = NULL;
+    inferFrame *frame;
+    inferOrder order;
+    int have_attr;
+
+    order.file = file;
+    order.seq = state->seq++;
+
+    if (depth == 0)
+    {
+        element = inferGetElement(&state->summary, name,
+                                  xmlTextReaderConstNamespaceUri(reader),
+                                  &order);
+        element->roots++;
+    }
+    else
+    {
+        inferFrame *parent = &state->frames[depth - 1];
+        inferElement *pelement = parent->element;
+        int i;
+
+        /* names come from the reader's dictionary */
+        for (i = 0; i < pelement->nchildren; i++)
+            if (pelement->children[i].element->name == name) break;
+        if (i == pelement->nchildren)
+        {
+            element = inferGetElement(&state->summary, name,
+                                      xmlTextReaderConstNamespaceUri(reader),
+                                      &order);
+            i = inferAddChild(pelement, element, &order);
+        }
+        element = pelement->children[i].element;
+
+        inferFrameCounts(parent, i);
+        if (parent->last != i)
+        {
+            if (parent->counts[i] > 0) pelement->unordered = 1;
+            if (parent->last >= 0)
+                pelement->follows[parent->last * pelement->maxchildren + i] = 1;
+        }
+        parent->counts[i]++;
+        parent->last = i;
+        parent->children++;
+    }
+
+    element->count++;
+    frame = inferGetFrame(state, depth);
+    frame->element = element;
+    frame->used = 0;
+    frame->last = -1;
+    frame->children = 0;
+    frame->text = 0;
+    frame->length = 0;
+
+    for (have_attr = xmlTextReaderMoveToFirstAttribute(reader);
+         have_attr > 0;
+         have_attr = xmlTextReaderMoveToNextAttribute(reader))
+    {
+        const xmlChar *value;
+        inferAttr *attr;
+
+        order.seq = state->seq++;
+        attr = inferGetAttr(element, xmlTextReaderConstName(reader),
+                            xmlTextReaderConstNamespaceUri(reader), &order);
+        attr->count++;
+        value = xmlTextReaderConstValue(reader);
+        inferAddValue(&attr->values, value, xmlStrlen(value));
+    }
+    xmlTextReaderMoveToElement(reader);
+}
+
+/**
+ *  Text of the element at @depth
+ */
+static void
+inferText(inferState *state, int depth)
+{
+    inferFrame *frame = &state->frames[depth];
+    const xmlChar *value = xmlTextReaderConstValue(state->reader);
+    int len = xmlStrlen(value);
+
+    frame->text = 1;
+    if (frame->length < 0) return;
+    if (frame->length + len > INFER_MAX_VALUE)
+    {
+        frame->length = -1;
+        return;
+    }
+    memcpy(frame->value + frame->length, value, len);
+    frame->length += len;
+}
+
+/**
+ *  The element at @depth has ended
+ */
+static void
+inferEndElement(inferState *state, int depth)
+{
+    inferFrame *frame = &state->frames[depth];
+    inferElement *element = frame->element;
+    int i;
+
+    for (i = 0; i < element->nchildren; i++)
+    {
+        inferChild *child = &element->children[i];
+        int n = i < frame->used? frame->counts[i] : 0;
+
+        if (child->min < 0 || n < child->min) child->min = n;
+        if (n > child->max) child->max = n;
+    }
+
+    if (frame->children == 0)
+    {
+        if (frame->text)
+            inferAddValue(&element->values, frame->value, frame->length);
+        else
+            element->empty++;
+    }
+    else if (frame->text)
+        element->mixed = 1;
+
+    element->done++;
+}
+
+/**
+ *  Read file @filename (input file number @file) into @state's summary
+ */
+static int
+inferFile(inferState *state, const char *filename, int file)
+{
+    xmlTextReaderPtr reader = state->reader;
+    int ret;
+
+    if (!reader)
+        reader = state->reader = xmlReaderForFile(filename, NULL, 0);
+    else if (xmlReaderNewFile(reader, filename, NULL, 0) != 0)
+        reader = NULL;
+    if (!reader)
+    {
+        fprintf(stderr, "couldn't read file '%s'\n", filename);
+        return EXIT_BAD_FILE;
+    }
+
+    while ((ret = xmlTextReaderRead(reader)) > 0)
+    {
+        int depth = xmlTextReaderDepth(reader);
+
+        switch (xmlTextReaderNodeType(reader))
+        {
+        case XML_READER_TYPE_ELEMENT:
+            inferStartElement(state, depth, file);
+            if (xmlTextReaderIsEmptyElement(reader))
+                inferEndElement(state, depth);
+            break;
+        case XML_READER_TYPE_END_ELEMENT:
+            inferEndElement(state, depth);
+            break;
+        case XML_READER_TYPE_TEXT:
+        case XML_READER_TYPE_CDATA:
+            /* white space only text is reported as such, not as text */
+            if (depth > 0) inferText(state, depth - 1);
+            break;
+        default:
+            break;
+        }
+    }
+
+    return ret == -1? EXIT_LIB_ERROR : ret;
+}
+
+/*
+ *  Merging summaries
+ */
+
+typedef struct _inferMerge {
+    inferSummary *dst;
+    int *map;                 /* child indices of the source in dst */
+    int size;                 /* of map */
+    unsigned char *seen;      /* children of dst the source also had */
+    int seen_size;            /* of seen */
+} inferMerge;
+
+/**
+ *  Add the summary of element @payload to the one in @data->dst
+ */
+static void
+inferMergeElement(void *payload, void *data, const xmlChar *name)
+{
+    inferElement *src = payload;
+    inferMerge *merge = data;
+    inferSummary *dst = merge->dst;
+    inferElement *element;
+    int i, j;
+
+    name = xmlDictLookup(dst->dict, src->name, -1);
+    inferOutOfMemory((void *) name);
+    element = inferGetElement(dst, name,
+        src->href? xmlDictLookup(dst->dict, src->href, -1) : NULL,
+        &src->first);
+    if (inferOrderCompare(&src->first, &element->first) < 0)
+        element->first = src->first;
+
+    if (src->nchildren > merge->size)
+    {
+        merge->size = src->nchildren;
+        merge->map = xmlRealloc(merge->map, merge->size * sizeof(int));
+        inferOutOfMemory(merge->map);
+    }
+
+    /* new children are optional if dst had instances already (see
+       inferAddChild), the others if the source had instances */
+    if (element->nchildren + src->nchildren > merge->seen_size)
+    {
+        merge->seen_size = element->nchildren + src->nchildren;
+        merge->seen = xmlRealloc(merge->seen, merge->seen_size);
+        inferOutOfMemory(merge->seen);
+    }
+    if (merge->seen_size > 0)
+        memset(merge->seen, 0, merge->seen_size);
+    for (i = 0; i < src->nchildren; i++)
+    {
+        inferChild *schild = &src->children[i], *child;
+        inferElement *celement;
+        const xmlChar *cname =
+            xmlDictLookup(dst->dict, schild->element->name, -1);
+
+        inferOutOfMemory((void *) cname);
+        celement = inferGetElement(dst, cname,
+            schild->element->href?
+                xmlDictLookup(dst->dict, schild->element->href, -1) : NULL,
+            &schild->first);
+        j = inferAddChild(element, celement, &schild->first);
+        merge->map[i] = j;
+        merge->seen[j] = 1;
+        child = &element->children[j];
+        if (schild->min >= 0 && (child->min < 0 || schild->min < child->min))
+            child->min = schild->min;
+        if (schild->max > child->max) child->max = schild->max;
+        if (inferOrderCompare(&schild->first, &child->first) < 0)
+            child->first = schild->first;
+    }
+    if (src->done > 0)
+    {
+        for (j = 0; j < element->nchildren; j++)
+            if (!merge->seen[j]) element->children[j].min = 0;
+    }
+
+    for (i = 0; i < src->nchildren; i++)
+        for (j = 0; j < src->nchildren; j++)
+            if (src->follows[i * src->maxchildren + j])
+                element->follows[merge->map[i] * element->maxchildren +
+                                 merge->map[j]] = 1;
+
+    for (i = 0; i < src->nattrs; i++)
+    {
+        inferAttr *sattr = &src->attrs[i], *attr;
+        const xmlChar *aname = xmlDictLookup(dst->dict, sattr->name, -1);
+
+        inferOutOfMemory((void *) aname);
+        attr = inferGetAttr(element, aname,
+            sattr->href? xmlDictLookup(dst->dict, sattr->href, -1) : NULL,
+            &sattr->first);
+        attr->count += sattr->count;
+        inferMergeValues(&attr->values, &sattr->values);
+        if (inferOrderCompare(&sattr->first, &attr->first) < 0)
+            attr->first = sattr->first;
+    }
+
+    element->count += src->count;
+    element->done += src->done;
+    element->roots += src->roots;
+    element->empty += src->empty;
+    element->mixed |= src->mixed;
+    element->unordered |= src->unordered;
+    inferMergeValues(&element->values, &src->values);
+}
+
+/*
+ *  Printing schemas
+ */
+
+typedef struct {
+    inferElement **array;
+    int offset;
+} inferElementArray;
+
+static void
+inferElementPut(void *payload, void *data, const xmlChar *name)
+{
+    inferElementArray *dest = data;
+    dest->array[dest->offset++] = payload;
+}
+
+static int
+compare_element_first(const void *p1, const void *p2)
+{
+    inferElement *const *e1 = p1, *const *e2 = p2;
+    return inferOrderCompare(&(*e1)->first, &(*e2)->first);
+}
+
+/* namespace declarations go last */
+static int
+compare_attr_first(const void *p1, const void *p2)
+{
+    const inferAttr *a1 = p1, *a2 = p2;
+    int decl1 = inferIsNsDecl(a1->href), decl2 = inferIsNsDecl(a2->href);
+
+    if (decl1 != decl2) return decl1 - decl2;
+    return inferOrderCompare(&a1->first, &a2->first);
+}
+
+/**
+ *  Put the indices of the children of @element into @order, in the
+ *  order they come in; returns 0 (and puts them in order of appearance)
+ *  if they don't always come in the same order
+ */
+static int
+inferChildOrder(inferElement *element, int *order)
+{
+    int n = element->nchildren, i, j, k;
+
+    for (k = 0; k < n; k++)
+    {
+        int best = -1;
+
+        /* the first child not preceded by any child not yet placed */
+        for (i = 0; i < n && !element->unordered; i++)
+        {
+            for (j = 0; j < k; j++)
+                if (order[j] == i) break;
+            if (j < k) continue;
+            for (j = 0; j < n; j++)
+            {
+                int l;
+                if (j == i || !element->follows[j * element->maxchildren + i])
+                    continue;
+                for (l = 0; l < k; l++)
+                    if (order[l] == j) break;
+                if (l == k) break;
+            }
+            if (j < n) continue;
+            if (best < 0 || inferOrderCompare(&element->children[i].first,
+                                              &element->children[best].first) < 0)
+                best = i;
+        }
+        if (best < 0) break;
+        order[k] = best;
+    }
+    if (k == n) return 1;
+
+    /* no order: insertion sort by first appearance */
+    for (k = 0; k < n; k++)
+    {
+        for (i = k; i > 0 && inferOrderCompare(&element->children[k].first,
+                         &element->children[order[i - 1]].first) < 0; i--)
+            order[i] = order[i - 1];
+        order[i] = k;
+    }
+    return 0;
+}
+
+static int
+inferMinOccurs(const inferChild *child)
+{
+    return child->min > 0;
+}
+
+static int
+inferMaxOccurs(const inferChild *child)
+{
+    return child->max > 1? 2 : 1;
+}
+
+static const char *
+inferXsdType(inferKind kind)
+{
+    switch (kind)
+    {
+    case INFER_ENUMERATION: return "xs:token";
+    case INFER_INTEGER: return "xs:integer";
+    case INFER_DECIMALS: return "xs:decimal";
+    case INFER_DATES: return "xs:date";
+    default: return "xs:string";
+    }
+}
+
+static const char *
+inferRngType(inferKind kind)
+{
+    switch (kind)
+    {
+    case INFER_INTEGER: return "integer";
+    case INFER_DECIMALS: return "decimal";
+    case INFER_DATES: return "date";
+    default: return NULL;
+    }
+}
+
+static void
+inferPrintEscaped(const xmlChar *value)
+{
+    xmlChar *escaped = xmlEncodeSpecialChars(NULL, value);
+    inferOutOfMemory(escaped);
+    printf("%s", escaped);
+    xmlFree(escaped);
+}
+
+/**
+ *  Print a DTD element declaration and attribute list for @element
+ */
+static void
+inferPrintDtd(inferElement *element, int *order)
+{
+    int ordered = inferChildOrder(element, order), i;
+
+    printf("<!ELEMENT %s ", element->name);
+    if (element->nchildren == 0)
+        printf(element->values.count? "(#PCDATA)" : "EMPTY");
+    else if (element->values.count || element->mixed)
+    {
+        printf("(#PCDATA");
+        for (i = 0; i < element->nchildren; i++)
+            printf("|%s", element->children[order[i]].element->name);
+        printf(")*");
+    }
+    else
+    {
+        printf("(");
+        for (i = 0; i < element->nchildren; i++)
+        {
+            inferChild *child = &element->children[order[i]];
+            printf("%s%s", i? (ordered? ", " : "|") : "", child->element->name);
+            if (ordered)
+            {
+                if (inferMaxOccurs(child) > 1)
+                    printf(inferMinOccurs(child)? "+" : "*");
+                else if (!inferMinOccurs(child))
+                    printf("?");
+            }
+        }
+        printf(ordered? ")" : ")*");
+    }
+    printf(">\n");
+
+    if (element->nattrs == 0) return;
+    printf("<!ATTLIST %s", element->name);
+    for (i = 0; i < element->nattrs; i++)
+    {
+        inferAttr *attr = &element->attrs[i];
+
+        printf("\n  %s ", attr->name);
+        if (inferIsNsDecl(attr->href))
+        {
+            /* a namespace declaration is the same wherever it is seen */
+            if (attr->values.nenum == 1)
+            {
+                printf("CDATA #FIXED \"");
+                inferPrintEscaped(attr->values.enums[0]);
+                printf("\"");
+            }
+            else
+                printf("CDATA #IMPLIED");
+            continue;
+        }
+        if (inferValueKind(&attr->values, 0) == INFER_ENUMERATION &&
+            (attr->values.types & INFER_NMTOKEN))
+        {
+            int j;
+            for (j = 0; j < attr->values.nenum; j++)
+                printf("%s%s", j? "|" : "(", attr->values.enums[j]);
+            printf(")");
+        }
+        else
+            printf("CDATA");
+        printf(attr->count == element->count? " #REQUIRED" : " #IMPLIED");
+    }
+    printf(">\n");
+}
+
+static void
+inferPrintXsdEnum(inferValues *values, const char *indent)
+{
+    int i;
+
+    printf("%s<xs:simpleType>\n", indent);
+    printf("%s  <xs:restriction base=\"xs:token\">\n", indent);
+    for (i = 0; i < values->nenum; i++)
+    {
+        printf("%s    <xs:enumeration value=\"", indent);
+        inferPrintEscaped(values->enums[i]);
+        printf("\"/>\n");
+    }
+    printf("%s  </xs:restriction>\n", indent);
+    printf("%s</xs:simpleType>\n", indent);
+}
+
+static void
+inferPrintXsdAttrs(inferElement *element, const char *indent)
+{
+    char deeper[32];
+    int i;
+
+    for (i = 0; i < element->nattrs - element->nsdecls; i++)
+    {
+        inferAttr *attr = &element->attrs[i];
+        inferKind kind = inferValueKind(&attr->values, 0);
+
+        printf("%s<xs:attribute name=\"%s\"", indent, attr->name);
+        if (kind != INFER_ENUMERATION)
+            printf(" type=\"%s\"", inferXsdType(kind));
+        if (attr->count == element->count)
+            printf(" use=\"required\"");
+        if (kind != INFER_ENUMERATION)
+        {
+            printf("/>\n");
+            continue;
+        }
+        printf(">\n");
+        sprintf(deeper, "%s  ", indent);
+        inferPrintXsdEnum(&attr->values, deeper);
+        printf("%s</xs:attribute>\n", indent);
+    }
+}
+
+/**
+ *  Print an XML Schema element declaration for @element
+ */
+static void
+inferPrintXsd(inferElement *element, int *order)
+{
+    int ordered = inferChildOrder(element, order), i;
+    int nattrs = element->nattrs - element->nsdecls;
+    inferKind kind;
+
+    printf("  <xs:element name=\"%s\"", element->name);
+
+    if (element->nchildren == 0 && element->values.count)
+    {
+        kind = inferValueKind(&element->values, element->empty > 0);
+        if (nattrs == 0)
+        {
+            if (kind != INFER_ENUMERATION)
+            {
+                printf(" type=\"%s\"/>\n", inferXsdType(kind));
+                return;
+            }
+            printf(">\n");
+            inferPrintXsdEnum(&element->values, "    ");
+            printf("  </xs:element>\n");
+            return;
+        }
+        printf(">\n");
+        printf("    <xs:complexType>\n");
+        printf("      <xs:simpleContent>\n");
+        printf("        <xs:extension base=\"%s\">\n", inferXsdType(kind));
+        inferPrintXsdAttrs(element, "          ");
+        printf("        </xs:extension>\n");
+        printf("      </xs:simpleContent>\n");
+        printf("    </xs:complexType>\n");
+        printf("  </xs:element>\n");
+        return;
+    }
+
+    printf(">\n");
+    if (element->nchildren == 0 && nattrs == 0)
+    {
+        printf("    <xs:complexType/>\n");
+        printf("  </xs:element>\n");
+        return;
+    }
+
+    printf("    <xs:complexType%s>\n",
+           element->nchildren && (element->values.count || element->mixed)?
+           " mixed=\"true\"" : "");
+    if (element->nchildren)
+    {
+        const char *group = "sequence";
+        int repeat = 0;
+
+        if (!ordered)
+        {
+            group = "all";
+            for (i = 0; i < element->nchildren; i++)
+                if (inferMaxOccurs(&element->children[i]) > 1) group = "choice";
+            repeat = (group[0] == 'c');
+        }
+        printf("      <xs:%s%s>\n", group,
+               repeat? " minOccurs=\"0\" maxOccurs=\"unbounded\"" : "");
+        for (i = 0; i < element->nchildren; i++)
+        {
+            inferChild *child = &element->children[order[i]];
+
+            printf("        <xs:element ref=\"%s\"", child->element->name);
+            if (!repeat && !inferMinOccurs(child))
+                printf(" minOccurs=\"0\"");
+            if (!repeat && inferMaxOccurs(child) > 1)
+                printf(" maxOccurs=\"unbounded\"");
+            printf("/>\n");
+        }
+        printf("      </xs:%s>\n", group);
+    }
+    inferPrintXsdAttrs(element, "      ");
+    printf("    </xs:complexType>\n");
+    printf("  </xs:element>\n");
+}
+
+/**
+ *  Print @name (a qualified name in namespace @href) as the name
+ *  of a RELAX NG element or attribute pattern
+ */
+static void
+inferPrintRngName(const xmlChar *name, const xmlChar *href)
+{
+    const xmlChar *colon = xmlStrchr(name, ':');
+
+    if (href && *href)
+        printf(" name=\"%s\" ns=\"%s\"", colon? colon + 1 : name, href);
+    else
+        printf(" name=\"%s\"", name);
+}
+
+/**
+ *  Print the name of the define for @element, prefixes are separated
+ *  with '.' as define names are NCNames
+ */
+static void
+inferPrintRngDefine(const xmlChar *name)
+{
+    const xmlChar *colon = xmlStrchr(name, ':');
+
+    if (colon)
+        printf("%.*s.%s", (int) (colon - name), name, colon + 1);
+    else
+        printf("%s", name);
+}
+
+static void
+inferPrintRngValues(inferValues *values, inferKind kind, const char *indent)
+{
+    int i;
+
+    if (kind == INFER_ENUMERATION)
+    {
+        printf("%s<choice>\n", indent);
+        for (i = 0; i < values->nenum; i++)
+        {
+            printf("%s  <value>", indent);
+            inferPrintEscaped(values->enums[i]);
+            printf("</value>\n");
+        }
+        printf("%s</choice>\n", indent);
+    }
+    else if (inferRngType(kind))
+        printf("%s<data type=\"%s\"/>\n", indent, inferRngType(kind));
+    else
+        printf("%s<text/>\n", indent);
+}
+
+/**
+ *  Print a RELAX NG define for @element
+ */
+static void
+inferPrintRng(inferElement *element, int *order)
+{
+    int ordered = inferChildOrder(element, order), i;
+    int nattrs = element->nattrs - element->nsdecls;
+    const char *indent = "      ";
+
+    printf("  <define name=\"");
+    inferPrintRngDefine(element->name);
+    printf("\">\n");
+    printf("    <element");
+    inferPrintRngName(element->name, element->href);
+    printf(">\n");
+
+    /* namespace declarations are not attributes to RELAX NG */
+    for (i = 0; i < nattrs; i++)
+    {
+        inferAttr *attr = &element->attrs[i];
+        inferKind kind = inferValueKind(&attr->values, 0);
+        int optional = attr->count < element->count;
+
+        if (optional) printf("      <optional>\n");
+        printf("%s%s<attribute", indent, optional? "  " : "");
+        inferPrintRngName(attr->name, attr->href);
+        if (kind == INFER_STRING)
+            printf("/>\n");
+        else
+        {
+            printf(">\n");
+            inferPrintRngValues(&attr->values, kind,
+                                optional? "          " : "        ");
+            printf("%s%s</attribute>\n", indent, optional? "  " : "");
+        }
+        if (optional) printf("      </optional>\n");
+    }
+
+    if (element->nchildren == 0)
+    {
+        if (element->values.count)
+            inferPrintRngValues(&element->values,
+                inferValueKind(&element->values, element->empty > 0), indent);
+        else if (nattrs == 0)
+            printf("%s<empty/>\n", indent);
+    }
+    else
+    {
+        int mixed = element->values.count || element->mixed;
+        int interleave = !ordered && element->nchildren > 1;
+
+        if (mixed)
+        {
+            printf("%s<mixed>\n", indent);
+            indent = "        ";
+        }
+        if (interleave)
+        {
+            printf("%s<interleave>\n", indent);
+            indent = mixed? "          " : "        ";
+        }
+        for (i = 0; i < element->nchildren; i++)
+        {
+            inferChild *child = &element->children[order[i]];
+            const char *wrap = NULL;
+
+            if (inferMaxOccurs(child) > 1)
+                wrap = inferMinOccurs(child)? "oneOrMore" : "zeroOrMore";
+            else if (!inferMinOccurs(child))
+                wrap = "optional";
+            if (wrap) printf("%s<%s>\n%s  ", indent, wrap, indent);
+            else printf("%s", indent);
+            printf("<ref name=\"");
+            inferPrintRngDefine(child->element->name);
+            printf("\"/>\n");
+            if (wrap) printf("%s</%s>\n", indent, wrap);
+        }
+        if (interleave)
+            printf("%s</interleave>\n", mixed? "        " : "      ");
+        if (mixed)
+            printf("      </mixed>\n");
+    }
+
+    printf("    </element>\n");
+    printf("  </define>\n");
+}
+
+/**
+ *  Find a name in a namespace other than that of namespace declarations
+ *  among @elements, which a schema without a target namespace (and one
+ *  per namespace imported into it) can't declare; returns NULL if there
+ *  is none
+ */
+static const xmlChar *
+inferNamespacedName(inferElementArray *elements)
+{
+    int i, j;
+
+    for (i = 0; i < elements->offset; i++)
+    {
+        inferElement *element = elements->array[i];
+
+        if (element->href && *element->href) return element->name;
+        for (j = 0; j < element->nattrs - element->nsdecls; j++)
+            if (element->attrs[j].href) return element->attrs[j].name;
+    }
+    return NULL;
+}
+
+/**
+ *  Print the schema for @summary; returns an exit status
+ */
+static int
+inferPrintSchema(inferSummary *summary)
+{
+    inferElementArray elements;
+    const xmlChar *name;
+    int i, roots = 0, maxchildren = 1;
+    int *order;
+
+    elements.array = xmlMalloc((xmlHashSize(summary->elements) + 1) *
+                               sizeof(inferElement *));
+    inferOutOfMemory(elements.array);
+    elements.offset = 0;
+    xmlHashScan(summary->elements, inferElementPut, &elements);
+    if (elements.offset > 1)
+        qsort(elements.array, elements.offset, sizeof(inferElement *),
+              compare_element_first);
+
+    for (i = 0; i < elements.offset; i++)
+    {
+        inferElement *element = elements.array[i];
+        if (element->nattrs > 1)
+            qsort(element->attrs, element->nattrs, sizeof(inferAttr),
+                  compare_attr_first);
+        if (element->nchildren > maxchildren)
+            maxchildren = element->nchildren;
+        if (element->roots) roots++;
+    }
+
+    if (inferOps.format == INFER_XSD &&
+        (name = inferNamespacedName(&elements)) != NULL)
+    {
+        fprintf(stderr, "error: --xsd can't describe namespaced name '%s',"
+                " use --rng\n", name);
+        xmlFree(elements.array);
+        return EXIT_FAILURE;
+    }
+
+    order = xmlMalloc(maxchildren * sizeof(int));
+    inferOutOfMemory(order);
+
+    switch (inferOps.format)
+    {
+    case INFER_DTD:
+        for (i = 0; i < elements.offset; i++)
+            inferPrintDtd(elements.array[i], order);
+        break;
+
+    case INFER_XSD:
+        printf("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n");
+        printf("<xs:schema xmlns:xs=\"http://www.w3.org/2001/XMLSchema\">\n");
+        for (i = 0; i < elements.offset; i++)
+            inferPrintXsd(elements.array[i], order);
+        printf("</xs:schema>\n");
+        break;
+
+    case INFER_RNG:
+        printf("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n");
+        printf("<grammar xmlns=\"http://relaxng.org/ns/structure/1.0\""
+               " datatypeLibrary=\"http://www.w3.org/2001/XMLSchema-datatypes\">\n");
+        printf("  <start>\n");
+        if (roots == 0)
+            printf("    <notAllowed/>\n");
+        if (roots > 1)
+            printf("    <choice>\n");
+        for (i = 0; i < elements.offset; i++)
+        {
+            if (!elements.array[i]->roots) continue;
+            printf(roots > 1? "      <ref name=\"" : "    <ref name=\"");
+            inferPrintRngDefine(elements.array[i]->name);
+            printf("\"/>\n");
+        }
+        if (roots > 1)
+            printf("    </choice>\n");
+        printf("  </start>\n");
+        for (i = 0; i < elements.offset; i++)
+            inferPrintRng(elements.array[i], order);
+        printf("</grammar>\n");
+        break;
+    }
+
+    xmlFree(order);
+    xmlFree(elements.array);
+    return EXIT_SUCCESS;
+}
+
+/*
+ *  Job handlers
+ */
+
+static void *
+infer_init_state(void *shared)
+{
+    inferState *state = xmlMalloc(sizeof(inferState));
+
+    inferOutOfMemory(state);
+    memset(state, 0, sizeof(inferState));
+    inferSummaryInit(&state->summary, NULL);
+    return state;
+}
+
+static int
+infer_run_file(void *shared, void *local, int item, xmlBufferPtr out)
+{
+    inferJob *job = shared;
+    return inferFile(local, job->files[item], item);
+}
+
+static void
+infer_done_file(void *shared, int item, int status, xmlBufferPtr out)
+{
+    inferJob *job = shared;
+    if (status) job->status = status;
+}
+
+/**
+ *  Merge a worker's summary into the job's and free the worker
+ */
+static void
+infer_fini_state(void *shared, void *local)
+{
+    inferJob *job = shared;
+    inferState *state = local;
+    inferMerge merge;
+    int i;
+
+    if (!state) return;
+    memset(&merge, 0, sizeof(merge));
+    merge.dst = &job->summary;
+    xmlHashScan(state->summary.elements, inferMergeElement, &merge);
+    xmlFree(merge.map);
+    xmlFree(merge.seen);
+
+    /* names of the worker's summary belong to its reader */
+    inferSummaryFree(&state->summary);
+    xmlFreeTextReader(state->reader);
+    for (i = 0; i < state->nframes; i++)
+        xmlFree(state->frames[i].counts);
+    xmlFree(state->frames);
+    xmlFree(state);
+}
+
+/**
+ *  Add the files named in @listname to @job's files; returns 0 if the
+ *  list can not be read
+ */
+static int
+infer_files_from(inferJob *job, const char *listname)
+{
+    FILE *list = stdin;
+    char *line = NULL;
+    size_t size = 0;
+    int nalloc = job->nfiles;
+
+    if (strcmp(listname, "-"))
+    {
+        list = fopen(listname, "r");
+        if (list == NULL)
+        {
+            fprintf(stderr, "Error: could not open: %s\n", listname);
+            return 0;
+        }
+    }
+
+    while (readListLine(list, &line, &size))
+    {
+        if (job->nfiles == nalloc)
+        {
+            nalloc = nalloc < 64? 64 : nalloc * 2;
+            job->files = xmlRealloc(job->files, nalloc * sizeof(char *));
+            inferOutOfMemory(job->files);
+        }
+        job->files[job->nfiles++] = (char *) xmlStrdup(BAD_CAST line);
+    }
+    xmlFree(line);
+
+    if (list != stdin) fclose(list);
+    return 1;
+}
+
+static const char *
+infer_option_arg(int argc, char **argv, int i)
+{
+    if (i + 1 >= argc)
+    {
+        fprintf(stderr, "error: %s needs an argument\n", argv[i]);
+        inferUsage(argc, argv, EXIT_BAD_ARGS);
+    }
+    return argv[i + 1];
+}
+
+/**
+ *  This is the main function for 'infer' option
+ */
+int
+inferMain(int argc, char **argv)
+{
+    static const jobHandlers infer_handlers =
+        { infer_init_state, infer_run_file, infer_done_file, infer_fini_state };
+    int i, nargs, status;
+    inferJob job;
+
+    inferOps.format = INFER_XSD;
+    inferOps.jobs = 1;
+    inferOps.files_from = NULL;
+
+    for (i = 2; i < argc && argv[i][0] == '-' && argv[i][1] != '\0'; i++)
+    {
+        if (!strcmp(argv[i], "--help") || !strcmp(argv[i], "-h") ||
+            !strcmp(argv[i], "-?") || !strcmp(argv[i], "-Z"))
+        {
+            inferUsage(argc, argv, EXIT_SUCCESS);
+        }
+        else if (!strcmp(argv[i], "--xsd"))
+        {
+            inferOps.format = INFER_XSD;
+        }
+        else if (!strcmp(argv[i], "--dtd"))
+        {
+            inferOps.format = INFER_DTD;
+        }
+        else if (!strcmp(argv[i], "--rng"))
+        {
+            inferOps.format = INFER_RNG;
+        }
+        else if (!strcmp(argv[i], "-j") || !strcmp(argv[i], "--jobs"))
+        {
+            inferOps.jobs = parseJobCount(infer_option_arg(argc, argv, i++));
+            if (inferOps.jobs == 0) inferUsage(argc, argv, EXIT_BAD_ARGS);
+        }
+        else if (!strcmp(argv[i], "--files-from"))
+        {
+            inferOps.files_from = infer_option_arg(argc, argv, i++);
+        }
+        else
+            inferUsage(argc, argv, EXIT_BAD_ARGS);
+    }
+
+    memset(&job, 0, sizeof(job));
+    job.status = EXIT_SUCCESS;
+    inferSummaryInit(&job.summary, xmlDictCreate());
+    inferOutOfMemory(job.summary.dict);
+
+    nargs = argc - i;
+    job.files = xmlMalloc((nargs + 1) * sizeof(char *));
+    inferOutOfMemory(job.files);
+    for (job.nfiles = 0; job.nfiles < nargs; job.nfiles++)
+        job.files[job.nfiles] = (char *) xmlStrdup(BAD_CAST argv[i + job.nfiles]);
+    if (nargs == 0 && !inferOps.files_from)
+        job.files[job.nfiles++] = (char *) xmlStrdup(BAD_CAST "-");
+    if (inferOps.files_from && !infer_files_from(&job, inferOps.files_from))
+        job.status = EXIT_BAD_FILE;
+
+    runJobs(inferOps.jobs, job.nfiles, &job, &infer_handlers);
+    status = inferPrintSchema(&job.summary);
+    if (job.status == EXIT_SUCCESS) job.status = status;
+
+    inferSummaryFree(&job.summary);
+    for (i = 0; i < job.nfiles; i++)
+        xmlFree(job.files[i]);
+    xmlFree(job.files);
+
+    return job.status;
+}
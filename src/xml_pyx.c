@@ -12,50 +12,149 @@
  *  ESIS Generation by Sean Mc Grath http://www.digitome.com/sean.html
  */
 
+#include <config.h>
+
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 #include <libxml/parser.h>
 #include <libxml/parserInternals.h>
+#if HAVE_ZLIB
+#include <zlib.h>
+#endif
 
 #include "xmlstar.h"
+#include "scan.h"
+
+#if !HAVE_DECL_O_BINARY
+# define O_BINARY 0
+#endif
+
+/* size of the output buffer, it is written out when full */
+#define PYX_OUTPUT_SIZE (256 * 1024)
+
+/* size of the chunks read from files and pipes for the push parser */
+#define PYX_READ_SIZE (1024 * 1024)
+
+/* up to this many attributes are sorted by insertion, more by qsort() */
+#define PYX_INSERTION_SORT_MAX 16
+
+/* state of a conversion, the user data of the SAX callbacks */
+typedef struct _pyxContext {
+    char *out;                /* PYX_OUTPUT_SIZE bytes of output */
+    size_t used;
+    char *in;                 /* PYX_READ_SIZE bytes of input */
+    int text;                 /* a '-' line is still open */
+    int sort;                 /* output attributes sorted by name */
+    const xmlChar ***atts;    /* scratch array for sorting attributes */
+    int attsSize;
+} pyxContext;
+
+/* the user data of the callbacks is the parser context (libxml2 only
+   looks up entities itself then), the pyx state hangs off that */
+#define PYX_CONTEXT(ctx) ((pyxContext *) ((xmlParserCtxtPtr) (ctx))->_private)
+
+/**
+ *  Write out the buffered output
+ */
+static void
+pyxFlush(pyxContext *pyx)
+{
+    if (pyx->used) fwrite(pyx->out, 1, pyx->used, stdout);
+    pyx->used = 0;
+}
+
+/**
+ *  Output @len bytes at @s
+ */
+static void
+pyxWrite(pyxContext *pyx, const void *s, size_t len)
+{
+    if (len > PYX_OUTPUT_SIZE - pyx->used)
+    {
+        pyxFlush(pyx);
+        if (len >= PYX_OUTPUT_SIZE)
+        {
+            fwrite(s, 1, len, stdout);
+            return;
+        }
+    }
+    memcpy(pyx->out + pyx->used, s, len);
+    pyx->used += len;
+}
+
+static void
+pyxPutc(pyxContext *pyx, char c)
+{
+    if (pyx->used == PYX_OUTPUT_SIZE) pyxFlush(pyx);
+    pyx->out[pyx->used++] = c;
+}
+
+static void
+pyxPuts(pyxContext *pyx, const xmlChar *s)
+{
+    pyxWrite(pyx, s, xmlStrlen(s));
+}
 
 /**
  *  Output newline and tab characters as escapes
  *  Required both for attribute values and character data (#PCDATA)
  */
 static void
-SanitizeData(const xmlChar *s, int len)
+SanitizeData(pyxContext *pyx, const xmlChar *s, int len)
 {
-    while (len--)
+    const char *p = (const char *) s, *end = p + len;
+
+    for (;;)
     {
-        switch (*s)
+        /* copy runs of plain bytes at once */
+        const char *q = scanChr4(p, end, '\n', '\r', '\t', '\\');
+        pyxWrite(pyx, p, q - p);
+        if (q == end) break;
+        switch (*q)
         {
-            case 10:
-                printf("\\n");
-                break;
-            case 13:
+            case '\n':
+                pyxWrite(pyx, "\\n", 2);
                 break;
-            case 9:
-                printf ("\\t");
+            case '\r':
                 break;
-            case '\\':
-                printf ("\\\\");
+            case '\t':
+                pyxWrite(pyx, "\\t", 2);
                 break;
             default:
-                putchar (*s);
+                pyxWrite(pyx, "\\\\", 2);
         }
-        s++;
+        p = q + 1;
+    }
+}
+
+/**
+ *  End the current line of character data, if any: adjacent character
+ *  data is output as one line, wherever the parser happens to split it
+ */
+static void
+pyxEndText(pyxContext *pyx)
+{
+    if (pyx->text)
+    {
+        pyxPutc(pyx, '\n');
+        pyx->text = 0;
     }
 }
 
 static void
-print_qname(const xmlChar *prefix, const xmlChar *localname)
+print_qname(pyxContext *pyx, const xmlChar *prefix, const xmlChar *localname)
 {
     if (prefix)
-        printf("%s:", prefix);
-    printf("%s", localname);
+    {
+        pyxPuts(pyx, prefix);
+        pyxPutc(pyx, ':');
+    }
+    pyxPuts(pyx, localname);
 }
 
 int
@@ -67,6 +166,52 @@ CompareAttributes(const void *a1,const void *a2)
     return xmlStrcmp(*attr1, *attr2);
 }
 
+/**
+ *  Get the @nb_attributes attributes (of 5 pointers each) sorted by name,
+ *  in pyx's scratch array which is only grown, never freed, between
+ *  elements
+ */
+static const xmlChar ***
+pyxSortAttributes(pyxContext *pyx, const xmlChar **attributes,
+                  int nb_attributes)
+{
+    const xmlChar ***atts;
+    int i, j;
+
+    if (nb_attributes > pyx->attsSize)
+    {
+        int size = pyx->attsSize? pyx->attsSize : 16;
+        while (size < nb_attributes) size *= 2;
+        atts = xmlRealloc(pyx->atts, size * sizeof(*atts));
+        if (!atts)
+        {
+            fprintf(stderr, "out of memory\n");
+            exit(EXIT_INTERNAL_ERROR);
+        }
+        pyx->atts = atts;
+        pyx->attsSize = size;
+    }
+    atts = pyx->atts;
+
+    if (nb_attributes > PYX_INSERTION_SORT_MAX)
+    {
+        for (i = 0; i < nb_attributes; i++)
+            atts[i] = &attributes[i * 5];
+        qsort(atts, nb_attributes, sizeof(*atts), CompareAttributes);
+        return atts;
+    }
+
+    /* few attributes, usually in order already: insertion sort */
+    for (i = 0; i < nb_attributes; i++)
+    {
+        const xmlChar **att = &attributes[i * 5];
+        for (j = i; j > 0 && xmlStrcmp(atts[j - 1][0], att[0]) > 0; j--)
+            atts[j] = atts[j - 1];
+        atts[j] = att;
+    }
+    return atts;
+}
+
 void
 pyxStartElement (void * ctx,
     const xmlChar * localname,
@@ -78,25 +223,19 @@ pyxStartElement (void * ctx,
     int nb_defaulted,
     const xmlChar ** attributes)
 {
+    pyxContext *pyx = PYX_CONTEXT(ctx);
     int i;
     /* DON'T modify the attributes array, ever. */
-    const xmlChar*** atts = &attributes;
+    const xmlChar ***atts = NULL;
 
-    fprintf(stdout,"(");
-    print_qname(prefix, localname);
-    fprintf(stdout, "\n");
+    pyxEndText(pyx);
+    pyxPutc(pyx, '(');
+    print_qname(pyx, prefix, localname);
+    pyxPutc(pyx, '\n');
 
-    if (nb_attributes > 1) {
-        atts = calloc(nb_attributes, sizeof(*atts));
-        for (i = 0; i < nb_attributes; ++i) {
-            atts[i] = &(attributes[i * 5]);
-        }
-        /* Sort the pairs based on the name part of the pair */
-        qsort (atts,
-            nb_attributes,
-            sizeof(*atts),
-            CompareAttributes);
-    }
+    /* Sort the attributes based on their name */
+    if (nb_attributes > 1 && pyx->sort)
+        atts = pyxSortAttributes(pyx, attributes, nb_attributes);
 
     for (i = 0; i < nb_namespaces; i++) {
         int aidx = i * 2;
@@ -104,52 +243,56 @@ pyxStartElement (void * ctx,
             *prefix = namespaces[aidx],
             *uri = namespaces[aidx+1];
         /* namespace definitions take the form xmlns:prefix=uri*/
-        putchar('A');
+        pyxPutc(pyx, 'A');
         if (xmlStrlen(prefix) > 0)
-            print_qname(BAD_CAST "xmlns", prefix);
+            print_qname(pyx, BAD_CAST "xmlns", prefix);
         else
-            fputs("xmlns", stdout);
-        putchar(' ');
-        SanitizeData(uri, xmlStrlen(uri));
-        putchar('\n');
+            pyxWrite(pyx, "xmlns", 5);
+        pyxPutc(pyx, ' ');
+        SanitizeData(pyx, uri, xmlStrlen(uri));
+        pyxPutc(pyx, '\n');
     }
 
     for (i = 0; i < nb_attributes; i++) {
-        const xmlChar *localname = atts[i][0],
-            *prefix = atts[i][1],
-            /* *nsURI = attributes[atts][2], */
-            *valueBegin = atts[i][3],
-            *valueEnd = atts[i][4];
+        const xmlChar **att = atts? atts[i] : &attributes[i * 5];
+        const xmlChar *localname = att[0],
+            *prefix = att[1],
+            /* *nsURI = att[2], */
+            *valueBegin = att[3],
+            *valueEnd = att[4];
         int valueLen = valueEnd - valueBegin;
 
         /* Attribute Name */
-        putchar('A');
-        print_qname(prefix, localname);
-        putchar(' ');
+        pyxPutc(pyx, 'A');
+        print_qname(pyx, prefix, localname);
+        pyxPutc(pyx, ' ');
         /* value - can contain literal "\n" so escape */
-        SanitizeData(valueBegin, valueLen);
-        putchar('\n');
+        SanitizeData(pyx, valueBegin, valueLen);
+        pyxPutc(pyx, '\n');
     }
-
-    /* we did only allocate memory if nb_attributes > 1 */
-    if (nb_attributes > 1) free(atts);
 }
 
 void
 pyxEndElement(void *userData, const xmlChar *localname, const xmlChar *prefix,
     const xmlChar *URI)
 {
-    fprintf(stdout,")");
-    print_qname(prefix, localname);
-    putchar('\n');
+    pyxContext *pyx = PYX_CONTEXT(userData);
+    pyxEndText(pyx);
+    pyxPutc(pyx, ')');
+    print_qname(pyx, prefix, localname);
+    pyxPutc(pyx, '\n');
 }
 
 void
 pyxCharacterData(void *userData, const xmlChar *s, int len)
 {
-    fprintf(stdout, "-");
-    SanitizeData(s, len);
-    putchar('\n');
+    pyxContext *pyx = PYX_CONTEXT(userData);
+    if (!pyx->text)
+    {
+        pyxPutc(pyx, '-');
+        pyx->text = 1;
+    }
+    SanitizeData(pyx, s, len);
 }
 
 void
@@ -157,9 +300,13 @@ pyxProcessingInstruction(void *userData,
                          const xmlChar *target, 
                          const xmlChar *data)
 {
-    fprintf(stdout,"?%s ",target);
-    SanitizeData(data, xmlStrlen(data));
-    fprintf(stdout,"\n");
+    pyxContext *pyx = PYX_CONTEXT(userData);
+    pyxEndText(pyx);
+    pyxPutc(pyx, '?');
+    pyxPuts(pyx, target);
+    pyxPutc(pyx, ' ');
+    SanitizeData(pyx, data, xmlStrlen(data));
+    pyxPutc(pyx, '\n');
 }
 
 void
@@ -169,10 +316,20 @@ pyxUnparsedEntityDeclHandler(void *userData,
                              const xmlChar *systemId,
                              const xmlChar *notationName)
 {
-    fprintf(stdout, "U%s %s %s%s%s\n", 
-           (char *)entityName, (char *)notationName, (char *)systemId,
-           (publicId == NULL? "": " "), 
-           (publicId == NULL? "": (char *) publicId));
+    pyxContext *pyx = PYX_CONTEXT(userData);
+    pyxEndText(pyx);
+    pyxPutc(pyx, 'U');
+    pyxPuts(pyx, entityName);
+    pyxPutc(pyx, ' ');
+    pyxPuts(pyx, notationName);
+    pyxPutc(pyx, ' ');
+    pyxPuts(pyx, systemId);
+    if (publicId != NULL)
+    {
+        pyxPutc(pyx, ' ');
+        pyxPuts(pyx, publicId);
+    }
+    pyxPutc(pyx, '\n');
 }
 
 void
@@ -181,53 +338,78 @@ pyxNotationDeclHandler(void *userData,
                        const xmlChar *publicId,
                        const xmlChar *systemId)
 {
-    fprintf(stdout, "N%s %s%s%s\n", (char*) notationName, (char*) systemId,
-           (publicId == NULL? "": " "), 
-           (publicId == NULL? "": (const char*) publicId));
+    pyxContext *pyx = PYX_CONTEXT(userData);
+    pyxEndText(pyx);
+    pyxPutc(pyx, 'N');
+    pyxPuts(pyx, notationName);
+    pyxPutc(pyx, ' ');
+    pyxPuts(pyx, systemId);
+    if (publicId != NULL)
+    {
+        pyxPutc(pyx, ' ');
+        pyxPuts(pyx, publicId);
+    }
+    pyxPutc(pyx, '\n');
 }
 
 void
 pyxExternalEntityReferenceHandler(void* userData,
                                   const xmlChar *name)
 {
+    pyxContext *pyx = PYX_CONTEXT(userData);
     const xmlChar *p = name;
-    fprintf (stdout, "&");
+    pyxEndText(pyx);
+    pyxPutc(pyx, '&');
     /* Up to space is the name of the referenced entity */
-    while (*p && (*p != ' ')) {
-        putchar (*p);
+    while (*p && (*p != ' '))
         p++;
-    }
+    pyxWrite(pyx, name, p - name);
 }
 
 static void
 pyxExternalSubsetHandler(void *ctx, const xmlChar *name,
                          const xmlChar *ExternalID, const xmlChar *SystemID)
 {
-    fprintf(stdout, "D %s PUBLIC", name); /* TODO: re-check */
+    pyxContext *pyx = PYX_CONTEXT(ctx);
+    pyxEndText(pyx);
+    pyxWrite(pyx, "D ", 2);
+    pyxPuts(pyx, name);
+    pyxWrite(pyx, " PUBLIC", 7); /* TODO: re-check */
     if (ExternalID == NULL)
-        fprintf(stdout, " ");
-    else
-        fprintf(stdout, " \"%s\"", ExternalID);
-    if (SystemID == NULL)
-        fprintf(stdout, "\n");
+        pyxPutc(pyx, ' ');
     else
-        fprintf(stdout, " \"%s\"\n", SystemID);
+    {
+        pyxWrite(pyx, " \"", 2);
+        pyxPuts(pyx, ExternalID);
+        pyxPutc(pyx, '"');
+    }
+    if (SystemID != NULL)
+    {
+        pyxWrite(pyx, " \"", 2);
+        pyxPuts(pyx, SystemID);
+        pyxPutc(pyx, '"');
+    }
+    pyxPutc(pyx, '\n');
 }
 
 static void
 pyxCommentHandler(void *ctx, const xmlChar *value)
 {
-    fprintf(stdout,"C");
-    SanitizeData(value, xmlStrlen(value));
-    fprintf(stdout,"\n");
+    pyxContext *pyx = PYX_CONTEXT(ctx);
+    pyxEndText(pyx);
+    pyxPutc(pyx, 'C');
+    SanitizeData(pyx, value, xmlStrlen(value));
+    pyxPutc(pyx, '\n');
 }
 
 static void
 pyxCdataBlockHandler(void *ctx, const xmlChar *value, int len)
 {
-    fprintf(stdout,"[");
-    SanitizeData(value, len);
-    fprintf(stdout,"\n");
+    pyxContext *pyx = PYX_CONTEXT(ctx);
+    pyxEndText(pyx);
+    pyxPutc(pyx, '[');
+    SanitizeData(pyx, value, len);
+    pyxPutc(pyx, '\n');
 }
 
 static void
@@ -243,42 +425,279 @@ pyxUsage(const char *argv0, exit_status status)
 
 static xmlSAXHandler pyxSAX;
 
+/**
+ *  Parse @filename, letting libxml2 read it (used for URLs and compressed
+ *  files, which libxml2 decompresses itself)
+ */
 static int
-pyx_process_file(const char *filename)
+pyx_parse_file(pyxContext *pyx, const char *filename)
 {
     int ret;
     xmlParserCtxtPtr ctxt;
+    xmlSAXHandlerPtr sax;
 
     ctxt = xmlCreateFileParserCtxt(filename);
     if (!ctxt) /* assume it failed because of filename */
         return EXIT_BAD_FILE;
 
+    sax = ctxt->sax;
     ctxt->sax = &pyxSAX;
+    ctxt->_private = pyx;
     ret = xmlParseDocument(ctxt);
+    pyxEndText(pyx);
+    pyxFlush(pyx);
 
-    ctxt->sax = NULL; /* don't try to free pyxSAX */
+    ctxt->sax = sax; /* don't try to free pyxSAX */
     xmlFreeParserCtxt(ctxt);
 
     return (ret == 0)? 0 : EXIT_LIB_ERROR;
 }
 
+/**
+ *  Fill @buf with up to @size bytes from @fd, returns how many bytes were
+ *  read (less than @size only at the end of the input) or -1 on error
+ */
+static int
+pyxRead(int fd, char *buf, int size)
+{
+    int len = 0;
+
+    while (len < size)
+    {
+        int n = read(fd, buf + len, size - len);
+        if (n == 0) break;
+        if (n < 0)
+        {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        len += n;
+    }
+    return len;
+}
+
+/**
+ *  Whether @buf starts like a gzip, xz or lzma stream
+ */
+static int
+pyxCompressed(const char *buf, int len)
+{
+    const unsigned char *p = (const unsigned char *) buf;
+
+    return (len >= 2 && p[0] == 0x1f && p[1] == 0x8b) ||
+        (len >= 6 && !memcmp(p, "\xfd" "7zXZ\0", 6)) ||
+        (len >= 3 && p[0] == 0x5d && p[1] == 0 && p[2] == 0);
+}
+
+/**
+ *  Feed @len bytes at @chunk to the push parser *@ctxt, creating it with
+ *  the first bytes (for the encoding) if there is none yet
+ */
+static void
+pyxParseChunk(pyxContext *pyx, xmlParserCtxtPtr *ctxt, const char *filename,
+              const char *chunk, int len)
+{
+    int first = 0;
+
+    if (!*ctxt)
+    {
+        first = len < 4? len : 4;
+        *ctxt = xmlCreatePushParserCtxt(&pyxSAX, NULL, chunk, first, filename);
+        if (!*ctxt) return;
+        (*ctxt)->_private = pyx;
+    }
+    if (len > first)
+        xmlParseChunk(*ctxt, chunk + first, len - first, 0);
+}
+
+/**
+ *  End the document of push parser @ctxt and free it; @ok is 0 if the
+ *  input could not be read to its end.  Returns the exit status
+ */
+static int
+pyxParseEnd(pyxContext *pyx, xmlParserCtxtPtr ctxt, int ok)
+{
+    int ret;
+
+    xmlParseChunk(ctxt, NULL, 0, 1);
+    pyxEndText(pyx);
+    pyxFlush(pyx);
+
+    ret = (ctxt->wellFormed && ok)? 0 : EXIT_LIB_ERROR;
+    /* the document libxml2 made to hold the entities of the internal
+       subset, xmlParseDocument() frees it but the push parser doesn't */
+    if (ctxt->myDoc) xmlFreeDoc(ctxt->myDoc);
+    xmlFreeParserCtxt(ctxt);
+    return ret;
+}
+
+#if HAVE_ZLIB
+/**
+ *  Parse the gzip stream on @fd (a pipe, that libxml2 can't read from
+ *  the start anymore) whose first @len bytes are in the input buffer;
+ *  like libxml2 with files, anything after the first gzip member is
+ *  ignored
+ */
+static int
+pyx_process_gzip(pyxContext *pyx, const char *filename, int fd, int len)
+{
+    xmlParserCtxtPtr ctxt = NULL;
+    z_stream zs;
+    char *out;
+    int zret = Z_OK;
+
+    out = xmlMalloc(PYX_READ_SIZE);
+    memset(&zs, 0, sizeof(zs));
+    if (!out || inflateInit2(&zs, 16 + MAX_WBITS) != Z_OK)
+    {
+        fprintf(stderr, "out of memory\n");
+        exit(EXIT_INTERNAL_ERROR);
+    }
+
+    zs.next_in = (Bytef *) pyx->in;
+    zs.avail_in = len;
+    while (zret == Z_OK && !(ctxt && ctxt->disableSAX))
+    {
+        if (zs.avail_in == 0)
+        {
+            len = pyxRead(fd, pyx->in, PYX_READ_SIZE);
+            if (len <= 0) break;
+            zs.next_in = (Bytef *) pyx->in;
+            zs.avail_in = len;
+        }
+        zs.next_out = (Bytef *) out;
+        zs.avail_out = PYX_READ_SIZE;
+        zret = inflate(&zs, Z_NO_FLUSH);
+        if ((zret == Z_OK || zret == Z_STREAM_END) &&
+            zs.avail_out < PYX_READ_SIZE)
+        {
+            pyxParseChunk(pyx, &ctxt, filename,
+                          out, PYX_READ_SIZE - zs.avail_out);
+            if (!ctxt) break;
+        }
+    }
+
+    if (len < 0)
+        fprintf(stderr, "%s: %s\n", filename, strerror(errno));
+    else if (zret != Z_STREAM_END && !(ctxt && ctxt->disableSAX))
+        fprintf(stderr, "%s: %s\n", filename,
+                zs.msg? zs.msg : "unexpected end of compressed data");
+    inflateEnd(&zs);
+    xmlFree(out);
+
+    if (!ctxt) pyxParseChunk(pyx, &ctxt, filename, NULL, 0);
+    if (!ctxt) return EXIT_LIB_ERROR;
+    return pyxParseEnd(pyx, ctxt, len >= 0 && zret == Z_STREAM_END);
+}
+#endif
+
+/**
+ *  Parse @filename (stdin if "-"), feeding the push parser with large
+ *  chunks read directly from the file or pipe
+ */
+static int
+pyx_process_file(pyxContext *pyx, const char *filename)
+{
+    int fd, len, ret;
+    xmlParserCtxtPtr ctxt = NULL;
+
+    if (strcmp(filename, "-") == 0)
+    {
+        fd = 0;
+#if HAVE_SETMODE && HAVE_DECL_O_BINARY
+        setmode(fd, O_BINARY);
+#endif
+    }
+    else if (strstr(filename, "://") == NULL)
+        fd = open(filename, O_RDONLY | O_BINARY);
+    else
+        fd = -1;
+    if (fd < 0) /* a URL, or failing that report the error as libxml2 does */
+        return pyx_parse_file(pyx, filename);
+
+#if HAVE_POSIX_FADVISE && defined(POSIX_FADV_SEQUENTIAL)
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+    len = pyxRead(fd, pyx->in, PYX_READ_SIZE);
+    if (len <= 0) /* leave the errors, and empty documents, to libxml2 */
+    {
+        if (fd != 0) close(fd);
+        return pyx_parse_file(pyx, filename);
+    }
+    if (pyxCompressed(pyx->in, len))
+    {
+        /* libxml2 has to read it from the start to decompress it */
+        if (fd != 0)
+        {
+            close(fd);
+            return pyx_parse_file(pyx, filename);
+        }
+        if (lseek(fd, -len, SEEK_CUR) >= 0)
+            return pyx_parse_file(pyx, filename);
+#if HAVE_ZLIB
+        if ((unsigned char) pyx->in[0] == 0x1f)
+            return pyx_process_gzip(pyx, filename, fd, len);
+#endif
+        fprintf(stderr, "%s: compressed input can only be read from a file\n",
+                filename);
+        return EXIT_BAD_FILE;
+    }
+
+    pyxParseChunk(pyx, &ctxt, filename, pyx->in, len);
+    if (!ctxt)
+    {
+        if (fd != 0) close(fd);
+        return EXIT_LIB_ERROR;
+    }
+    while (len == PYX_READ_SIZE && !ctxt->disableSAX)
+    {
+        len = pyxRead(fd, pyx->in, PYX_READ_SIZE);
+        if (len > 0)
+            xmlParseChunk(ctxt, pyx->in, len, 0);
+    }
+    if (len < 0)
+        fprintf(stderr, "%s: %s\n", filename, strerror(errno));
+    ret = pyxParseEnd(pyx, ctxt, len >= 0);
+    if (fd != 0) close(fd);
+
+    return ret;
+}
+
 int
 pyxMain(int argc,const char *argv[])
 {
     int status = 0;
+    int i;
+    pyxContext pyx;
 
-    if ((argc > 2) &&
-        (
-           (strcmp(argv[2],"-h") == 0) ||
-           (strcmp(argv[2],"-H") == 0) ||
-           (strcmp(argv[2],"-Z") == 0) ||
-           (strcmp(argv[2],"-?") == 0) ||
-           (strcmp(argv[2],"--help") == 0)
-       ))
+    memset(&pyx, 0, sizeof(pyx));
+    pyx.sort = 1;
+
+    for (i = 2; i < argc && argv[i][0] == '-' && argv[i][1] != '\0'; i++)
     {
-        pyxUsage(argv[0], EXIT_SUCCESS);
+        if (!strcmp(argv[i], "-h") || !strcmp(argv[i], "-H") ||
+            !strcmp(argv[i], "-Z") || !strcmp(argv[i], "-?") ||
+            !strcmp(argv[i], "--help"))
+        {
+            pyxUsage(argv[0], EXIT_SUCCESS);
+        }
+        else if (!strcmp(argv[i], "--no-sort"))
+        {
+            pyx.sort = 0;
+        }
+        else if (!strcmp(argv[i], "--"))
+        {
+            i++;
+            break;
+        }
+        else
+        {
+            pyxUsage(argv[0], EXIT_BAD_ARGS);
+        }
     }
 
+
     /* Establish Event Handlers */
     pyxSAX.startElementNs = pyxStartElement;
     pyxSAX.endElementNs = pyxEndElement;
@@ -292,16 +711,26 @@ pyxMain(int argc,const char *argv[])
     pyxSAX.cdataBlock = pyxCdataBlockHandler;
     pyxSAX.initialized = XML_SAX2_MAGIC;
 
-    if (argc == 2) {
-        status = pyx_process_file("-");
+    pyx.out = xmlMalloc(PYX_OUTPUT_SIZE);
+    pyx.in = xmlMalloc(PYX_READ_SIZE);
+    if (!pyx.out || !pyx.in)
+    {
+        fprintf(stderr, "out of memory\n");
+        exit(EXIT_INTERNAL_ERROR);
+    }
+
+    if (i == argc) {
+        status = pyx_process_file(&pyx, "-");
     }
     else {
-        argv++;
-        argc--;
-        for (++argv; argc>1; argc--,argv++) {
-            int ret = pyx_process_file(*argv);
+        for (; i < argc; i++) {
+            int ret = pyx_process_file(&pyx, argv[i]);
             if (ret != 0) status = ret;
         }
     }
+
+    xmlFree(pyx.atts);
+    xmlFree(pyx.in);
+    xmlFree(pyx.out);
     return status;
 }
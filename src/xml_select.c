@@ -649,15 +649,12 @@ do_file(const char *filename, xmlDocPtr style_tree,
     int xml_options, const selOptions *ops, xsltOptions *xsltOps,
     int *status)
 {
-    xmlChar *value;
+    xsltParams params;
     xmlDocPtr doc;
 
     /* Pass input file name as predefined parameter 'inputFile' */
-    const char *params[2+1] = { "inputFile" };
-    value = xmlStrdup((const xmlChar *)"'");
-    value = xmlStrcat(value, (const xmlChar *)filename);
-    value = xmlStrcat(value, (const xmlChar *)"'");
-    params[1] = (char *) value;
+    xsltInitParams(&params);
+    xsltAddParam(&params, BAD_CAST "inputFile", 9, BAD_CAST filename, 0);
 
 
     doc = readXml(filename, xml_options);
@@ -673,7 +670,7 @@ do_file(const char *filename, xmlDocPtr style_tree,
             if (!style) exit(EXIT_LIB_ERROR);
         }
 
-        res = xsltTransform(xsltOps, doc, params, style, filename);
+        res = xsltTransform(xsltOps, doc, &params, style, filename);
         if (!ops->quiet && (!res || xsltSaveResultToFile(stdout, res, style) < 0))
         {
             *status = EXIT_LIB_ERROR;
@@ -687,7 +684,7 @@ do_file(const char *filename, xmlDocPtr style_tree,
         *status = EXIT_BAD_FILE;
     }
 
-    xmlFree(value);
+    xsltFreeParams(&params);
 }
 
 /**
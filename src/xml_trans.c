@@ -34,6 +34,7 @@ THE SOFTWARE.
 
 #include "xmlstar.h"
 #include "trans.h"
+#include "jobs.h"
 
 /*
  *  TODO:
@@ -59,6 +60,24 @@ trUsage(const char *argv0, exit_status status)
     exit(status);
 }
 
+#ifdef XSLT_STREAM_SPLIT
+/**
+ *  Check whether --output-name @pattern has the record number %r
+ */
+static int
+trNameHasRecord(const char *pattern)
+{
+    const char *p;
+    for (p = pattern; *p; p++)
+    {
+        if (*p != '%') continue;
+        if (p[1] == 'r') return 1;
+        if (p[1]) p++;
+    }
+    return 0;
+}
+#endif
+
 /**
  *  Parse global command line options
  */
@@ -96,6 +115,54 @@ trParseOptions(xsltOptionsPtr ops, int argc, char **argv)
             {
                 ops->omit_decl = 1;
             }
+            else if (!strcmp(argv[i], "--jobs") || !strcmp(argv[i], "-j"))
+            {
+                i++;
+                if (i >= argc) trUsage(argv[0], EXIT_BAD_ARGS);
+                ops->jobs = parseJobCount(argv[i]);
+                if (!ops->jobs) trUsage(argv[0], EXIT_BAD_ARGS);
+            }
+            else if (!strcmp(argv[i], "--output-dir") || !strcmp(argv[i], "-O"))
+            {
+                i++;
+                if (i >= argc) trUsage(argv[0], EXIT_BAD_ARGS);
+                ops->output_dir = argv[i];
+            }
+            else if (!strcmp(argv[i], "--files-from"))
+            {
+                i++;
+                if (i >= argc) trUsage(argv[0], EXIT_BAD_ARGS);
+                ops->files_from = argv[i];
+            }
+            else if (!strcmp(argv[i], "--profile"))
+            {
+                ops->profile = 1;
+            }
+            else if (!strncmp(argv[i], "--profile=", 10) && argv[i][10])
+            {
+                ops->profile = 1;
+                ops->profile_file = argv[i] + 10;
+            }
+            else if (!strcmp(argv[i], "--params-file"))
+            {
+                i++;
+                if (i >= argc) trUsage(argv[0], EXIT_BAD_ARGS);
+                ops->params_file = argv[i];
+            }
+            else if (!strcmp(argv[i], "--output-name"))
+            {
+                i++;
+                if (i >= argc) trUsage(argv[0], EXIT_BAD_ARGS);
+                ops->output_name = argv[i];
+            }
+#ifdef XSLT_STREAM_SPLIT
+            else if (!strcmp(argv[i], "--stream-split"))
+            {
+                i++;
+                if (i >= argc) trUsage(argv[0], EXIT_BAD_ARGS);
+                ops->stream_split = argv[i];
+            }
+#endif
             else if (!strcmp(argv[i], "--maxdepth"))
             {
                 int value;
@@ -121,95 +188,52 @@ trParseOptions(xsltOptionsPtr ops, int argc, char **argv)
             break;
     }
 
+    /* embedded stylesheets come with every document */
+    if (ops->embed && ops->files_from) trUsage(argv[0], EXIT_BAD_ARGS);
+#ifdef XSLT_STREAM_SPLIT
+    /* every record is a result file of its own */
+    if (ops->stream_split && ops->output_dir && ops->output_name &&
+        !trNameHasRecord(ops->output_name))
+        trUsage(argv[0], EXIT_BAD_ARGS);
+#endif
+
     return i;
 }
 
+/**
+ *  Add one -p or -s parameter, @arg is <name>=<value>
+ */
+static void
+trAddParam(xsltParamsPtr params, const char *arg, int xpath,
+           const char *argv0)
+{
+    const char *eq = strchr(arg, '=');
+
+    if (eq == NULL) trUsage(argv0, EXIT_BAD_ARGS);
+    if (xsltAddParam(params, BAD_CAST arg, eq - arg, BAD_CAST eq + 1, xpath) < 0)
+    {
+        fprintf(stderr, "invalid XPath expression for parameter %s\n", arg);
+        exit(EXIT_BAD_ARGS);
+    }
+}
+
 /**
  *  Parse command line for XSLT parameters
  */
 int
-trParseParams(const char** params, int* plen,
-              int count, char **argv)
+trParseParams(xsltParamsPtr params, int count, char **argv)
 {
     int i;
-    *plen = 0;
-    params[0] = 0;
 
     for (i=0; i<count; i++)
     {
         if (argv[i][0] == '-')
         {
-            if (!strcmp(argv[i], "-p"))
-            {
-                int j;
-                xmlChar *name, *value;
-                
-                i++;
-                if (i >= count) trUsage(argv[0], EXIT_BAD_ARGS);
-
-                for(j=0; argv[i][j] && (argv[i][j] != '='); j++);
-                if (argv[i][j] != '=') trUsage(argv[0], EXIT_BAD_ARGS);
-                
-                name = xmlStrndup((const xmlChar *) argv[i], j);
-                value = xmlStrdup((const xmlChar *) argv[i]+j+1);
-
-                if (*plen >= MAX_PARAMETERS)
-                {
-                    fprintf(stderr, "too many params increase MAX_PARAMETERS\n");
-                    exit(EXIT_INTERNAL_ERROR);
-                }
-
-                params[*plen] = (char *)name;
-                (*plen)++;
-                params[*plen] = (char *)value;
-                (*plen)++;                
-                params[*plen] = 0;
-            }
-            else if (!strcmp(argv[i], "-s"))
+            if (!strcmp(argv[i], "-p") || !strcmp(argv[i], "-s"))
             {
-                int j;
-                const xmlChar *string;
-                xmlChar *name, *value;
-
                 i++;
                 if (i >= count) trUsage(argv[0], EXIT_BAD_ARGS);
-
-                for(j=0; argv[i][j] && (argv[i][j] != '='); j++);
-                if (argv[i][j] != '=') trUsage(argv[0], EXIT_BAD_ARGS);
-
-                name = xmlStrndup((const xmlChar *)argv[i], j);
-                string = (const xmlChar *)(argv[i]+j+1);
-
-                if (xmlStrchr(string, '"'))
-                {
-                    if (xmlStrchr(string, '\''))
-                    {
-                        fprintf(stderr,
-                            "string parameter contains both quote and double-quotes\n");
-                        exit(EXIT_INTERNAL_ERROR);
-                    }
-                    value = xmlStrdup((const xmlChar *)"'");
-                    value = xmlStrcat(value, string);
-                    value = xmlStrcat(value, (const xmlChar *)"'");
-                }
-                else
-                {
-                    value = xmlStrdup((const xmlChar *)"\"");
-                    value = xmlStrcat(value, string);
-                    value = xmlStrcat(value, (const xmlChar *)"\"");
-                }
-
-                if (*plen >= MAX_PARAMETERS)
-                {
-                    fprintf(stderr, "too many params increase MAX_PARAMETERS\n");
-                    exit(EXIT_INTERNAL_ERROR);
-                }
-
-                params[*plen] = (char *)name;
-                (*plen)++;
-                params[*plen] = (char *)value;
-                (*plen)++;
-                params[*plen] = 0;
+                trAddParam(params, argv[i], argv[i-1][1] == 'p', argv[0]);
             }
         }
         else
@@ -220,18 +244,47 @@ trParseParams(const char** params, int* plen,
 }
 
 /**
- *  Cleanup memory allocated by XSLT parameters
+ *  Read parameters from @filename, which has a "-p <name>=<value>" or
+ *  "-s <name>=<value>" on every line; empty lines and lines starting
+ *  with # are ignored, as are names given on the command line (the
+ *  first @given ones of @params)
  */
-void
-trCleanupParams(const char **xsltParams)
+static void
+trReadParamsFile(xsltParamsPtr params, int given, const char *filename,
+                 const char *argv0)
 {
-    const char **p = xsltParams;
+    FILE *file = stdin;
+    char *line = NULL, *eq;
+    size_t size = 0;
 
-    while (*p)
+    if (strcmp(filename, "-"))
     {
-        xmlFree((char *)*p);
-        p++;
+        file = fopen(filename, "r");
+        if (file == NULL)
+        {
+            fprintf(stderr, "error: could not open: %s\n", filename);
+            exit(EXIT_BAD_FILE);
+        }
+    }
+
+    while (readListLine(file, &line, &size))
+    {
+        if (line[0] == '#') continue;
+        if (line[0] != '-' || (line[1] != 'p' && line[1] != 's') ||
+            line[2] != ' ')
+        {
+            fprintf(stderr, "%s: bad parameter line: %s\n", filename, line);
+            exit(EXIT_BAD_ARGS);
+        }
+        eq = strchr(line + 3, '=');
+        if (eq && xsltHasParam(params, given, BAD_CAST line + 3,
+                               eq - (line + 3)))
+            continue;
+        trAddParam(params, line + 3, line[1] == 'p', argv0);
     }
+    xmlFree(line);
+
+    if (file != stdin) fclose(file);
 }
 
 /**
@@ -241,11 +294,10 @@ int
 trMain(int argc, char **argv)
 {
     static xsltOptions ops;
-    static const char *xsltParams[2 * MAX_PARAMETERS + 1];
+    xsltParams params;
 
     int errorno = 0;
     int start, xslt_ind;
-    int pCount;
     
     if (argc <= 2) trUsage(argv[0], EXIT_BAD_ARGS);
 
@@ -254,15 +306,18 @@ trMain(int argc, char **argv)
     xslt_ind = start;
     xsltInitLibXml(&ops);
 
-    /* set parameters */
-    start += trParseParams(xsltParams, &pCount, argc-start-1, argv+start+1);
+    /* set parameters, those on the command line take precedence */
+    xsltInitParams(&params);
+    start += trParseParams(&params, argc-start-1, argv+start+1);
+    if (ops.params_file)
+        trReadParamsFile(&params, params.count, ops.params_file, argv[0]);
     
     /* run transformation */
-    errorno = xsltRun(&ops, argv[xslt_ind], xsltParams,
+    errorno = xsltRun(&ops, argv[xslt_ind], &params,
                       argc-start-1, argv+start+1);
 
     /* free resources */
-    trCleanupParams(xsltParams);
+    xsltFreeParams(&params);
     
     return errorno;                                                
 }
@@ -34,6 +34,7 @@ THE SOFTWARE.
 
 #include "xmlstar.h"
 #include "trans.h"
+#include "jobs.h"
 
 #ifdef LIBXML_SCHEMAS_ENABLED
 #include <libxml/xmlschemas.h>
@@ -45,12 +46,14 @@ THE SOFTWARE.
 #endif
 
 #include <libxml/xmlreader.h>
+#include <libxml/valid.h>
+#include <libxml/hash.h>
+#include <libxml/parserInternals.h>
 
 /*
  *   TODO: Use cases
  *   1. find malfomed XML documents in a given set of XML files 
  *   2. find XML documents which do not match DTD/XSD in a given set of XML files
- *   3. precompile DTD once
  */
 
 typedef struct _valOptions {
@@ -64,6 +67,8 @@ typedef struct _valOptions {
     int   listGood;           /* >0 list good, <0 list bad */
     int   show_val_res;       /* display file names and valid/invalid message */
     int   nonet;              /* disallow network access */
+    int   jobs;               /* number of files to validate in parallel */
+    char *filesFrom;          /* read more file names from here */
 } valOptions;
 
 typedef valOptions *valOptionsPtr;
@@ -96,6 +101,8 @@ valInitOptions(valOptionsPtr ops)
     ops->schema = NULL;
     ops->relaxng = NULL;
     ops->nonet = 1;
+    ops->jobs = 1;
+    ops->filesFrom = NULL;
 
     if (globalOptions.quiet) {
         ops->listGood = 0;
@@ -181,14 +188,28 @@ valParseOptions(valOptionsPtr ops, int argc, char **argv)
             ops->nonet = 0;
             i++;
         }
+        else if (!strcmp(argv[i], "--jobs") || !strcmp(argv[i], "-j"))
+        {
+            i++;
+            if (i >= argc) valUsage(argc, argv, EXIT_BAD_ARGS);
+            ops->jobs = parseJobCount(argv[i]);
+            if (!ops->jobs) valUsage(argc, argv, EXIT_BAD_ARGS);
+            i++;
+        }
         else if (!strcmp(argv[i], "--help") || !strcmp(argv[i], "-h"))
         {
             valUsage(argc, argv, EXIT_SUCCESS);
         }
-        else if (!strcmp(argv[i], "-"))
+        else if (!strcmp(argv[i], "--files-from"))
         {
             i++;
-            break;
+            if (i >= argc) valUsage(argc, argv, EXIT_BAD_ARGS);
+            ops->filesFrom = argv[i];
+            i++;
+        }
+        else if (!strcmp(argv[i], "-"))
+        {
+            return i;
         }
         else if (argv[i][0] == '-')
         {
@@ -196,87 +217,710 @@ valParseOptions(valOptionsPtr ops, int argc, char **argv)
         }
         else
         {
-            i++;
-            break;
+            return i;
         }
     }
 
-    return i-1;
+    return argc;
 }
 
-/**
- *  Validate XML document against DTD
+/*
+ *  State shared by all validation jobs, read-only while they run
  */
-int
-valAgainstDtd(valOptionsPtr ops, char* dtdvalid, xmlDocPtr doc, char* filename)
+typedef struct _valJob {
+    valOptionsPtr ops;
+    char **files;
+    int options;              /* parser options */
+    int invalidFound;         /* only touched by valDone() */
+    xmlDtdPtr dtd;            /* external DTD, parsed once */
+#ifdef LIBXML_SCHEMAS_ENABLED
+    xmlSchemaPtr schema;
+    xmlRelaxNGPtr relaxng;
+#endif
+    ErrorInfo *errorInfo;     /* error info of the main thread */
+} valJob;
+
+/*
+ *  Per worker state
+ */
+typedef struct _valWorker {
+    xmlTextReaderPtr reader;
+#ifdef LIBXML_SCHEMAS_ENABLED
+    xmlSchemaValidCtxtPtr schemaCtxt;
+#endif
+    xmlHashTablePtr ids;      /* ID values seen in the current file */
+    xmlHashTablePtr idrefs;   /* IDREF values seen in the current file */
+    ErrorInfo errorInfo;
+} valWorker;
+
+static void *
+valWorkerInit(void *shared)
 {
-    int result = 0;
+    valJob *job = shared;
+    valWorker *worker = xmlMalloc(sizeof(valWorker));
 
-    if (dtdvalid != NULL)
+    worker->reader = NULL;
+    worker->ids = NULL;
+    worker->idrefs = NULL;
+    worker->errorInfo = *job->errorInfo;
+#ifdef LIBXML_SCHEMAS_ENABLED
+    worker->schemaCtxt = NULL;
+    if (job->schema)
     {
-        xmlDtdPtr dtd;
-
-#if !defined(LIBXML_VALID_ENABLED)
-	xmlGenericError(xmlGenericErrorContext,
-	"libxml2 has no validation support");
-	return 2;
-#endif
-        dtd = xmlParseDTD(NULL, (const xmlChar *)dtdvalid);
-        if (dtd == NULL)
+        worker->schemaCtxt = xmlSchemaNewValidCtxt(job->schema);
+        if (!worker->schemaCtxt)
         {
-            xmlGenericError(xmlGenericErrorContext,
-            "Could not parse DTD %s\n", dtdvalid);
-            result = 2;
+            fprintf(stderr, "out of memory\n");
+            exit(EXIT_INTERNAL_ERROR);
         }
+    }
+#endif
+    xmlSetStructuredErrorFunc(&worker->errorInfo, reportError);
+    return worker;
+}
+
+static void
+valWorkerFini(void *shared, void *local)
+{
+    valJob *job = shared;
+    valWorker *worker = local;
+
+    xmlSetStructuredErrorFunc(job->errorInfo, reportError);
+    xmlFreeTextReader(worker->reader);
+#ifdef LIBXML_SCHEMAS_ENABLED
+    xmlSchemaFreeValidCtxt(worker->schemaCtxt);
+#endif
+    xmlFree(worker);
+}
+
+/**
+ *  Point the worker's reader at @filename, returns 0 on success
+ */
+static int
+valOpenReader(valWorker *worker, char *filename, int options)
+{
+    int failed = 0;
+
+    if (!worker->reader)
+    {
+        if (strcmp(filename, "-") == 0)
+            worker->reader = xmlReaderForFd(/* STDIN_FILENO */ 0, "-", NULL,
+                                            options);
         else
+            worker->reader = xmlReaderForFile(filename, NULL, options);
+    }
+    else
+    {
+        failed = xmlReaderNewFile(worker->reader, filename, NULL, options);
+    }
+
+    worker->errorInfo.xmlReader = worker->reader;
+    worker->errorInfo.filename = filename;
+
+    return !worker->reader || failed;
+}
+
+#if defined(LIBXML_VALID_ENABLED) && defined(LIBXML_REGEXP_ENABLED)
+
+/**
+ *  Build the content model automata of all element declarations up
+ *  front, otherwise libxml2 does it lazily while validating, which
+ *  would modify the DTD shared by the jobs
+ */
+static void
+valBuildContentModel(void *payload, void *data, const xmlChar *name)
+{
+    xmlElementPtr elem = payload;
+    if (elem->etype == XML_ELEMENT_TYPE_ELEMENT)
+        xmlValidBuildContentModel(data, elem);
+}
+
+static xmlDtdPtr
+valLoadDtd(const char *filename)
+{
+    xmlDtdPtr dtd;
+    xmlValidCtxtPtr cvp;
+
+    dtd = xmlParseDTD(NULL, (const xmlChar *) filename);
+    if (dtd == NULL)
+    {
+        xmlGenericError(xmlGenericErrorContext,
+            "Could not parse DTD %s\n", filename);
+        return NULL;
+    }
+
+    cvp = xmlNewValidCtxt();
+    if (cvp == NULL)
+    {
+        fprintf(stderr, "out of memory\n");
+        exit(EXIT_INTERNAL_ERROR);
+    }
+    if (dtd->elements)
+        xmlHashScan(dtd->elements, valBuildContentModel, cvp);
+    xmlFreeValidCtxt(cvp);
+
+    return dtd;
+}
+
+/**
+ *  Report a validity error at @line libxml2 has no public function for,
+ *  in the same format as reportError()
+ */
+static void
+valDtdError(valWorker *worker, long line, const char *msg,
+            const xmlChar *str1, const xmlChar *str2)
+{
+    if (worker->errorInfo.verbose)
+    {
+        fprintf(stderr, "%s:%ld.0: ", worker->errorInfo.filename, line);
+        fprintf(stderr, msg, str1, str2);
+        fprintf(stderr, "\n");
+    }
+    if (worker->errorInfo.stop == STOP)
+        exit(EXIT_FAILURE);
+}
+
+/* the first reference to an ID, reported if the ID is missing */
+typedef struct _valIdRef {
+    xmlChar *attrName;
+    long line;
+} valIdRef;
+
+/**
+ *  Remember the ID names referenced by attribute @attrName at @line
+ */
+static void
+valAddIdRefs(valWorker *worker, const xmlChar *attrName, long line,
+             const xmlChar *value, int many)
+{
+    const xmlChar *cur = value;
+
+    if (!worker->idrefs) worker->idrefs = xmlHashCreate(0);
+    while (*cur)
+    {
+        const xmlChar *start;
+        xmlChar *name;
+
+        while (IS_BLANK_CH(*cur)) cur++;
+        start = cur;
+        while (*cur && (!many || !IS_BLANK_CH(*cur))) cur++;
+        if (cur == start) break;
+        name = xmlStrndup(start, cur - start);
+        if (xmlHashLookup(worker->idrefs, name) == NULL)
         {
-            xmlValidCtxtPtr cvp;
+            valIdRef *ref = xmlMalloc(sizeof(valIdRef));
+            ref->attrName = xmlStrdup(attrName);
+            ref->line = line;
+            xmlHashAddEntry(worker->idrefs, name, ref);
+        }
+        xmlFree(name);
+    }
+}
+
+static void
+valFreeIdRef(void *payload, const xmlChar *name)
+{
+    valIdRef *ref = payload;
+    xmlFree(ref->attrName);
+    xmlFree(ref);
+}
+
+typedef struct {
+    valWorker *worker;
+    xmlDocPtr doc;
+    int valid;
+} valIdRefCheck;
+
+static void
+valCheckIdRef(void *payload, void *data, const xmlChar *name)
+{
+    valIdRefCheck *check = data;
+    valIdRef *ref = payload;
+
+    /* IDs of our DTD, or of the document's own DTD the parser found */
+    if ((check->worker->ids == NULL ||
+         xmlHashLookup(check->worker->ids, name) == NULL) &&
+        xmlGetID(check->doc, name) == NULL)
+    {
+        valDtdError(check->worker, ref->line,
+            "IDREF attribute %s references an unknown ID \"%s\"",
+            ref->attrName, name);
+        check->valid = 0;
+    }
+}
+
+/**
+ *  Check that the start tag has the attributes declared #REQUIRED for
+ *  element @elemDecl, and the namespace declarations declared #FIXED
+ */
+static int
+valDtdDeclaredAttributes(valWorker *worker, xmlElementPtr elemDecl,
+                         xmlNodePtr node, long line)
+{
+    xmlAttributePtr attrDecl;
+    xmlAttrPtr attr;
+    xmlNsPtr ns;
+    int valid = 1;
+
+    for (attrDecl = elemDecl->attributes; attrDecl; attrDecl = attrDecl->nexth)
+    {
+        int found = 0;
 
-            if ((cvp = xmlNewValidCtxt()) == NULL) 
+        /* fixed namespace declarations must match the ones given */
+        if (attrDecl->def == XML_ATTRIBUTE_FIXED &&
+            !attrDecl->prefix && xmlStrEqual(attrDecl->name, BAD_CAST "xmlns"))
+        {
+            for (ns = node->nsDef; ns; ns = ns->next)
             {
-                xmlGenericError(xmlGenericErrorContext,
-                    "Couldn't allocate validation context\n");
-                exit(-1);
+                if (ns->prefix == NULL &&
+                    !xmlStrEqual(attrDecl->defaultValue, ns->href))
+                {
+                    valDtdError(worker, line, "Element %s namespace name for"
+                                " default namespace does not match the DTD",
+                                node->name, NULL);
+                    valid = 0;
+                }
             }
-        
-            if (ops->err)
+        }
+        else if (attrDecl->def == XML_ATTRIBUTE_FIXED &&
+                 xmlStrEqual(attrDecl->prefix, BAD_CAST "xmlns"))
+        {
+            for (ns = node->nsDef; ns; ns = ns->next)
+            {
+                if (xmlStrEqual(attrDecl->name, ns->prefix) &&
+                    !xmlStrEqual(attrDecl->defaultValue, ns->href))
+                {
+                    valDtdError(worker, line, "Element %s namespace name for"
+                                " %s does not match the DTD",
+                                node->name, ns->prefix);
+                    valid = 0;
+                }
+            }
+        }
+
+        if (attrDecl->def != XML_ATTRIBUTE_REQUIRED)
+            continue;
+
+        if (!attrDecl->prefix && xmlStrEqual(attrDecl->name, BAD_CAST "xmlns"))
+        {
+            for (ns = node->nsDef; ns && !found; ns = ns->next)
+                found = (ns->prefix == NULL);
+        }
+        else if (xmlStrEqual(attrDecl->prefix, BAD_CAST "xmlns"))
+        {
+            for (ns = node->nsDef; ns && !found; ns = ns->next)
+                found = xmlStrEqual(ns->prefix, attrDecl->name);
+        }
+        else
+        {
+            for (attr = node->properties; attr && !found; attr = attr->next)
+                found = xmlStrEqual(attr->name, attrDecl->name) &&
+                    xmlStrEqual(attr->ns? attr->ns->prefix : NULL,
+                                attrDecl->prefix);
+        }
+
+        if (!found)
+        {
+            valDtdError(worker, line,
+                        "Element %s does not carry attribute %s",
+                        node->name, attrDecl->name);
+            valid = 0;
+        }
+    }
+
+    return valid;
+}
+
+/**
+ *  Check the attributes of the start tag the reader is positioned on
+ *  against the DTD; this is what xmlValidateOneElement() does, minus
+ *  the content model which is checked by xmlValidatePushElement()
+ */
+static int
+valDtdAttributes(valWorker *worker, xmlValidCtxtPtr cvp, xmlDtdPtr dtd,
+                 xmlDocPtr doc, xmlNodePtr node)
+{
+    xmlElementPtr elemDecl;
+    xmlAttributePtr attrDecl;
+    xmlAttrPtr attr;
+    xmlNsPtr ns;
+    xmlIDTablePtr ids;
+    long line = xmlGetLineNo(node);
+    int valid = 1;
+
+    /* in the order xmlValidateElement() checks them */
+    elemDecl = xmlGetDtdQElementDesc(dtd, node->name,
+                                     node->ns? node->ns->prefix : NULL);
+    if (elemDecl)
+        valid &= valDtdDeclaredAttributes(worker, elemDecl, node, line);
+
+    /* the reader frees attributes as it goes, and the parser has already
+       registered the IDs of the document's own DTD: libxml2 gets empty
+       ID and reference tables, dropped while the attributes are still
+       alive, and IDs and references are checked with our own tables */
+    ids = doc->ids;
+    doc->ids = NULL;
+    for (attr = node->properties; attr; attr = attr->next)
+    {
+        xmlChar *value = xmlNodeListGetString(doc, attr->children, 1);
+        valid &= xmlValidateOneAttribute(cvp, doc, node, attr, value);
+
+        attrDecl = xmlGetDtdQAttrDesc(dtd, node->name, attr->name,
+                                      attr->ns? attr->ns->prefix : NULL);
+        if (attrDecl && value && attrDecl->atype == XML_ATTRIBUTE_ID)
+        {
+            if (!worker->ids) worker->ids = xmlHashCreate(0);
+            if (xmlHashAddEntry(worker->ids, value, worker) != 0)
             {
-                cvp->userData = (void *) stderr;
-                cvp->error    = (xmlValidityErrorFunc) fprintf;
-                cvp->warning  = (xmlValidityWarningFunc) fprintf;
+                valDtdError(worker, line, "ID %s already defined",
+                            value, NULL);
+                valid = 0;
             }
-            else
+        }
+        else if (attrDecl && value &&
+            (attrDecl->atype == XML_ATTRIBUTE_IDREF ||
+             attrDecl->atype == XML_ATTRIBUTE_IDREFS))
+            valAddIdRefs(worker, attr->name, line, value,
+                         attrDecl->atype == XML_ATTRIBUTE_IDREFS);
+        xmlFree(value);
+    }
+    if (doc->ids) xmlFreeIDTable(doc->ids);
+    doc->ids = ids;
+    if (doc->refs)
+    {
+        xmlFreeRefTable(doc->refs);
+        doc->refs = NULL;
+    }
+
+    /* the prefix is the element's, as in xmlValidateOneElement() */
+    for (ns = node->nsDef; ns; ns = ns->next)
+        valid &= xmlValidateOneNamespace(cvp, doc, node,
+                                         node->ns? node->ns->prefix : NULL,
+                                         ns, ns->href);
+
+    return valid;
+}
+
+/**
+ *  Whether element @node is declared EMPTY in @dtd
+ */
+static int
+valDtdEmpty(xmlDtdPtr dtd, xmlNodePtr node)
+{
+    xmlElementPtr elemDecl = xmlGetDtdQElementDesc(dtd, node->name,
+                                     node->ns? node->ns->prefix : NULL);
+    return elemDecl && elemDecl->etype == XML_ELEMENT_TYPE_EMPTY;
+}
+
+/**
+ *  Validate one file against the external DTD while streaming through it
+ *  with the text reader, so no document tree is built
+ */
+static int
+valDtdFile(valJob *job, valWorker *worker, char *filename)
+{
+    xmlValidCtxtPtr cvp;
+    xmlDocPtr doc = NULL;
+    xmlNodePtr empty = NULL;  /* open EMPTY element reported to have content */
+    int ret, valid = 1;
+    int options = job->options;
+
+#if LIBXML_VERSION >= 20900
+    /* errors are reported at the line of the node */
+    options |= XML_PARSE_BIG_LINES;
+#endif
+    /* the content of entities is validated where they are referenced */
+    options |= XML_PARSE_NOENT;
+
+    if (valOpenReader(worker, filename, options))
+    {
+        if (job->ops->err)
+            fprintf(stderr, "couldn't read file '%s'\n", filename);
+        return 1; /* could not open file */
+    }
+
+    cvp = xmlNewValidCtxt();
+    if (cvp == NULL)
+    {
+        fprintf(stderr, "out of memory\n");
+        exit(EXIT_INTERNAL_ERROR);
+    }
+
+    while ((ret = xmlTextReaderRead(worker->reader)) == 1)
+    {
+        int type = xmlTextReaderNodeType(worker->reader);
+        xmlNodePtr node;
+        xmlDtdPtr intSubset, extSubset;
+
+        if (type != XML_READER_TYPE_ELEMENT &&
+            type != XML_READER_TYPE_END_ELEMENT &&
+            type != XML_READER_TYPE_TEXT &&
+            type != XML_READER_TYPE_CDATA &&
+            type != XML_READER_TYPE_WHITESPACE &&
+            type != XML_READER_TYPE_SIGNIFICANT_WHITESPACE &&
+            type != XML_READER_TYPE_COMMENT &&
+            type != XML_READER_TYPE_PROCESSING_INSTRUCTION)
+            continue;
+
+        /* like xmlValidateDtd(), temporarily make the document use
+           our DTD instead of its own; errors are reported at the line
+           of the node, not where the parser has read ahead to */
+        worker->errorInfo.xmlReader = NULL;
+        node = xmlTextReaderCurrentNode(worker->reader);
+        doc = node->doc;
+        intSubset = doc->intSubset;
+        extSubset = doc->extSubset;
+        doc->intSubset = NULL;
+        doc->extSubset = job->dtd;
+
+        switch (type)
+        {
+        case XML_READER_TYPE_ELEMENT:
+        {
+            const xmlChar *qname = xmlTextReaderConstName(worker->reader);
+            if (!xmlValidatePushElement(cvp, doc, node, qname))
             {
-                cvp->userData = (void *) NULL;
-                cvp->error    = (xmlValidityErrorFunc) NULL;
-                cvp->warning  = (xmlValidityWarningFunc) NULL;
+                /* a child of an EMPTY element is reported by libxml2 */
+                if (node->parent && node->parent->type == XML_ELEMENT_NODE &&
+                    valDtdEmpty(job->dtd, node->parent))
+                    empty = node->parent;
+                valid = 0;
             }
-                        
-            if (!xmlValidateDtd(cvp, doc, dtd))
+            valid &= valDtdAttributes(worker, cvp, job->dtd, doc, node);
+            if (xmlTextReaderIsEmptyElement(worker->reader))
+                valid &= xmlValidatePopElement(cvp, doc, node, qname);
+            break;
+        }
+        case XML_READER_TYPE_END_ELEMENT:
+            valid &= xmlValidatePopElement(cvp, doc, node,
+                xmlTextReaderConstName(worker->reader));
+            if (node == empty) empty = NULL;
+            break;
+        default:
+        {
+            xmlNodePtr parent = node->parent;
+
+            /* like xmlValidateOneElement(), any children of an element
+               declared EMPTY make it invalid, once; elsewhere comments
+               and processing instructions don't count */
+            if (parent && parent->type == XML_ELEMENT_NODE &&
+                valDtdEmpty(job->dtd, parent))
             {
-                if ((ops->listGood < 0) && !ops->show_val_res)
+                if (parent != empty)
                 {
-                    fprintf(stdout, "%s\n", filename);
+                    valDtdError(worker, xmlGetLineNo(parent),
+                        "Element %s was declared EMPTY this one has content",
+                        parent->name, NULL);
+                    valid = 0;
+                    empty = parent;
                 }
-                else if (ops->listGood == 0)
-                    xmlGenericError(xmlGenericErrorContext,
-                                    "%s: does not match %s\n",
-                                    filename, dtdvalid);
-                result = 3;
             }
-            else
+            else if (type != XML_READER_TYPE_COMMENT &&
+                     type != XML_READER_TYPE_PROCESSING_INSTRUCTION)
             {
-                if ((ops->listGood > 0) && !ops->show_val_res)
-                {
-                    fprintf(stdout, "%s\n", filename);
-                }
+                const xmlChar *text = xmlTextReaderConstValue(worker->reader);
+                valid &= xmlValidatePushCData(cvp, text, xmlStrlen(text));
             }
-            xmlFreeDtd(dtd);
-            xmlFreeValidCtxt(cvp);
+            break;
         }
+        }
+
+        doc->intSubset = intSubset;
+        doc->extSubset = extSubset;
+        worker->errorInfo.xmlReader = worker->reader;
     }
+    xmlFreeValidCtxt(cvp);
+
+    if (ret == 0 && doc && worker->idrefs)
+    {
+        valIdRefCheck check;
+        check.worker = worker;
+        check.doc = doc;
+        check.valid = 1;
+        xmlHashScan(worker->idrefs, valCheckIdRef, &check);
+        valid &= check.valid;
+    }
+    xmlHashFree(worker->ids, NULL);
+    worker->ids = NULL;
+    xmlHashFree(worker->idrefs, valFreeIdRef);
+    worker->idrefs = NULL;
+    worker->errorInfo.xmlReader = NULL;
+
+    if (ret != 0)
+        return 1; /* Malformed XML */
+
+    if (!valid && job->ops->listGood == 0)
+        xmlGenericError(xmlGenericErrorContext,
+                        "%s: does not match %s\n",
+                        filename, job->ops->dtd);
 
-    return result;
+    return !valid;
+}
+
+#else
+
+static xmlDtdPtr
+valLoadDtd(const char *filename)
+{
+    xmlGenericError(xmlGenericErrorContext,
+        "libxml2 has no validation support");
+    return NULL;
+}
+
+static int
+valDtdFile(valJob *job, valWorker *worker, char *filename)
+{
+    return 2;
+}
+
+#endif  /* LIBXML_VALID_ENABLED && LIBXML_REGEXP_ENABLED */
+
+/**
+ *  Check one file for well-formedness and validate it against
+ *  the embedded DTD, XSD or Relax-NG schema (if any)
+ */
+static int
+valReaderFile(valJob *job, valWorker *worker, char *filename)
+{
+    valOptionsPtr ops = job->ops;
+    int options = job->options;
+    int failed = 0;
+    int validating = ops->embed;
+
+    /* It makes no sense to continue if we are not reporting errors
+     * anyway. Note this doesn't apply to the --dtd case because the we
+     * can't stop there without aborting the whole program (and
+     * therefore we wouldn't be able to check multiple files).
+     */
+    int stop = ops->stop || !ops->err;
+
+    if (ops->embed) options |= XML_PARSE_DTDVALID;
+
+    if (!valOpenReader(worker, filename, options))
+    {
+#ifdef LIBXML_SCHEMAS_ENABLED
+        if (worker->schemaCtxt)
+        {
+            failed = xmlTextReaderSchemaValidateCtxt(worker->reader,
+                worker->schemaCtxt, 0);
+            validating = 1;
+        }
+        else if (job->relaxng)
+        {
+            failed = xmlTextReaderRelaxNGSetSchema(worker->reader,
+                job->relaxng);
+            validating = 1;
+        }
+#endif  /* LIBXML_SCHEMAS_ENABLED */
+
+        if (failed == 0)
+        {
+            int more_nodes;
+            do
+            {
+                more_nodes = xmlTextReaderRead(worker->reader);
+                failed =
+                    (more_nodes == -1)? 1 :
+                    (!validating)? 0 :
+                    xmlTextReaderIsValid(worker->reader) != 1;
+            } while (more_nodes == 1 && (!failed || !stop));
+        }
+    }
+    else
+    {
+        if (ops->err)
+            fprintf(stderr, "couldn't read file '%s'\n", filename);
+        failed = 1; /* could not open file */
+    }
+    worker->errorInfo.xmlReader = NULL;
+
+    return failed;
+}
+
+static int
+valRunFile(void *shared, void *local, int item, xmlBufferPtr out)
+{
+    valJob *job = shared;
+
+    if (job->ops->dtd)
+        return valDtdFile(job, local, job->files[item]);
+    else
+        return valReaderFile(job, local, job->files[item]);
+}
+
+/**
+ *  Report the result for one file
+ */
+static void
+valReport(valJob *job, const char *filename, int failed)
+{
+    valOptionsPtr ops = job->ops;
+
+    if (failed) job->invalidFound = 1;
+
+    if (!ops->show_val_res)
+    {
+        if ((ops->listGood > 0) && !failed)
+            fprintf(stdout, "%s\n", filename);
+        if ((ops->listGood < 0) && failed)
+            fprintf(stdout, "%s\n", filename);
+    }
+    else
+    {
+        if (!failed)
+            fprintf(stdout, "%s - valid\n", filename);
+        else
+            fprintf(stdout, "%s - invalid\n", filename);
+    }
+}
+
+/**
+ *  Report the result for one command line file, called in input order
+ */
+static void
+valDone(void *shared, int item, int failed, xmlBufferPtr out)
+{
+    valJob *job = shared;
+    valReport(job, job->files[item], failed);
+}
+
+/**
+ *  Validate the files named in @listname, one per line, as they come in.
+ *  The compiled schema stays loaded, so a single long running process can
+ *  serve any number of documents; results are flushed after every file so
+ *  the caller can wait for them on a pipe.
+ */
+static void
+valFilesFrom(valJob *job, const char *listname)
+{
+    FILE *list = stdin;
+    valWorker *worker;
+    char *line = NULL;
+    size_t size = 0;
+
+    if (strcmp(listname, "-"))
+    {
+        list = fopen(listname, "r");
+        if (list == NULL)
+        {
+            fprintf(stderr, "error: could not open: %s\n", listname);
+            job->invalidFound = 1;
+            return;
+        }
+    }
+
+    worker = valWorkerInit(job);
+    while (readListLine(list, &line, &size))
+    {
+        valReport(job, line, job->ops->dtd?
+            valDtdFile(job, worker, line) :
+            valReaderFile(job, worker, line));
+        fflush(stdout);
+    }
+    xmlFree(line);
+    valWorkerFini(job, worker);
+
+    if (list != stdin) fclose(list);
 }
 
 /**
@@ -288,7 +932,9 @@ valMain(int argc, char **argv)
     int start;
     static valOptions ops;
     static ErrorInfo errorInfo;
-    int invalidFound = 0;
+    static const jobHandlers valHandlers =
+        { valWorkerInit, valRunFile, valDone, valWorkerFini };
+    valJob job;
     int options = XML_PARSE_DTDLOAD | XML_PARSE_DTDATTR;
 
     if (argc <= 2) valUsage(argc, argv, EXIT_BAD_ARGS);
@@ -299,202 +945,72 @@ valMain(int argc, char **argv)
     errorInfo.verbose = ops.err;
     xmlSetStructuredErrorFunc(&errorInfo, reportError);
 
+    job.ops = &ops;
+    job.files = argv + start;
+    job.options = options;
+    job.invalidFound = 0;
+    job.dtd = NULL;
+    job.errorInfo = &errorInfo;
+#ifdef LIBXML_SCHEMAS_ENABLED
+    job.schema = NULL;
+    job.relaxng = NULL;
+#endif
+
     if (ops.dtd)
     {
-        /* xmlReader doesn't work with external dtd, have to use SAX
-         * interface */
-        int i;
-
         /* we have to exit() from the error reporting function to implement
            --stop */
         errorInfo.stop = ops.stop;
 
-        for (i=start; i<argc; i++)
-        {
-            xmlDocPtr doc;
-            int failed;
-
-            failed = 0;
-            doc = NULL;
-
-            errorInfo.filename = argv[i];
-            doc = readXml(argv[i], options);
-            if (doc)
-            {
-                /* TODO: precompile DTD once */                
-                failed = valAgainstDtd(&ops, ops.dtd, doc, argv[i]);
-                xmlFreeDoc(doc);
-            }
-            else
-            {
-                failed = 1; /* Malformed XML or could not open file */
-                if ((ops.listGood < 0) && !ops.show_val_res)
-                {
-                    fprintf(stdout, "%s\n", argv[i]);
-                }
-            }
-            if (failed) invalidFound = 1;
-
-            if (ops.show_val_res)
-            {
-                if (!failed)
-                    fprintf(stdout, "%s - valid\n", argv[i]);
-                else
-                    fprintf(stdout, "%s - invalid\n", argv[i]);
-            }
-        }
+        /* the DTD is parsed once and shared read-only by all jobs */
+        job.dtd = valLoadDtd(ops.dtd);
+        if (!job.dtd)
+            return 2;
     }
     else if (ops.schema || ops.relaxng || ops.embed || ops.wellFormed)
     {
-        int i;
-        xmlTextReaderPtr reader = NULL;
-
 #ifdef LIBXML_SCHEMAS_ENABLED
-        xmlSchemaPtr schema = NULL;
-        xmlSchemaParserCtxtPtr schemaParserCtxt = NULL;
-        xmlSchemaValidCtxtPtr schemaCtxt = NULL;
-
-        xmlRelaxNGPtr relaxng = NULL;
-        xmlRelaxNGParserCtxtPtr relaxngParserCtxt = NULL;
-        /* there is no xmlTextReaderRelaxNGValidateCtxt() !?  */
-
-        /* TODO: Do not print debug stuff */
+        /* the compiled schemas are shared read-only by all jobs */
         if (ops.schema)
         {
+            xmlSchemaParserCtxtPtr schemaParserCtxt;
+
             schemaParserCtxt = xmlSchemaNewParserCtxt(ops.schema);
             if (!schemaParserCtxt)
-            {
-                invalidFound = 2;
-                goto schemaCleanup;
-            }
+                return 2;
             errorInfo.filename = ops.schema;
-            schema = xmlSchemaParse(schemaParserCtxt);
-            if (!schema)
-            {
-                invalidFound = 2;
-                goto schemaCleanup;
-            }
-
+            job.schema = xmlSchemaParse(schemaParserCtxt);
             xmlSchemaFreeParserCtxt(schemaParserCtxt);
-            schemaCtxt = xmlSchemaNewValidCtxt(schema);
-            if (!schemaCtxt)
-            {
-                invalidFound = 2;
-                goto schemaCleanup;
-            }
-
+            if (!job.schema)
+                return 2;
         }
         else if (ops.relaxng)
         {
+            xmlRelaxNGParserCtxtPtr relaxngParserCtxt;
+
             relaxngParserCtxt = xmlRelaxNGNewParserCtxt(ops.relaxng);
             if (!relaxngParserCtxt)
-            {
-                invalidFound = 2;
-                goto schemaCleanup;
-            }
-
+                return 2;
             errorInfo.filename = ops.relaxng;
-            relaxng = xmlRelaxNGParse(relaxngParserCtxt);
-            if (!relaxng)
-            {
-                invalidFound = 2;
-                goto schemaCleanup;
-            }
-
+            job.relaxng = xmlRelaxNGParse(relaxngParserCtxt);
+            xmlRelaxNGFreeParserCtxt(relaxngParserCtxt);
+            if (!job.relaxng)
+                return 2;
         }
 #endif  /* LIBXML_SCHEMAS_ENABLED */
+    }
+    else
+        return 0;
 
-        for (i=start; i<argc; i++)
-        {
-            int failed = 0;
-            if (ops.embed) options |= XML_PARSE_DTDVALID;
-
-            if (!reader)
-            {
-                if (strcmp(argv[i], "-") == 0)
-                    reader = xmlReaderForFd(/* STDIN_FILENO */ 0, "-", NULL,
-                                            options);
-                else
-                    reader = xmlReaderForFile(argv[i], NULL, options);
-            }
-            else
-            {
-                failed = xmlReaderNewFile(reader, argv[i], NULL, options);
-            }
-
-            errorInfo.xmlReader = reader;
-            errorInfo.filename = argv[i];
-
-            /* It makes no sense to continue if we are not reporting errors
-             * anyway. Note this doesn't apply to the --dtd case because the we
-             * can't stop there without aborting the whole program (and
-             * therefore we wouldn't be able to check multiple files).
-             */
-            if (!ops.err)
-                ops.stop = STOP;
-
-            if (reader && !failed)
-            {
-#ifdef LIBXML_SCHEMAS_ENABLED
-                if (schemaCtxt)
-                {
-                    failed = xmlTextReaderSchemaValidateCtxt(reader,
-                        schemaCtxt, 0);
-                }
-                else if (relaxng)
-                {
-                    failed = xmlTextReaderRelaxNGSetSchema(reader,
-                        relaxng);
-                }
-#endif  /* LIBXML_SCHEMAS_ENABLED */
-
-                if (failed == 0)
-                {
-                    int more_nodes;
-                    int validating = (schema || relaxng || ops.embed);
-                    do
-                    {
-                        more_nodes = xmlTextReaderRead(reader);
-                        failed =
-                            (more_nodes == -1)? 1 :
-                            (!validating)? 0 :
-                            xmlTextReaderIsValid(reader) != 1;
-                    } while (more_nodes == 1 && (!failed || !ops.stop));
-                }
-            }
-            else
-            {
-                if (ops.err)
-                    fprintf(stderr, "couldn't read file '%s'\n", errorInfo.filename);
-                failed = 1; /* could not open file */
-            }
-            if (failed) invalidFound = 1;
-
-            if (!ops.show_val_res)
-            {
-                if ((ops.listGood > 0) && !failed)
-                    fprintf(stdout, "%s\n", argv[i]);
-                if ((ops.listGood < 0) && failed)
-                    fprintf(stdout, "%s\n", argv[i]);
-            }
-            else
-            {
-                if (!failed)
-                    fprintf(stdout, "%s - valid\n", argv[i]);
-                else
-                    fprintf(stdout, "%s - invalid\n", argv[i]);
-            }
-        }
-        errorInfo.xmlReader = NULL;
-        xmlFreeTextReader(reader);
+    runJobs(ops.jobs, argc - start, &job, &valHandlers);
+    if (ops.filesFrom)
+        valFilesFrom(&job, ops.filesFrom);
 
+    if (job.dtd) xmlFreeDtd(job.dtd);
 #ifdef LIBXML_SCHEMAS_ENABLED
-    schemaCleanup:
-        xmlSchemaFreeValidCtxt(schemaCtxt);
-        xmlRelaxNGFree(relaxng);
-        xmlSchemaFree(schema);
+    xmlRelaxNGFree(job.relaxng);
+    xmlSchemaFree(job.schema);
 #endif  /* LIBXML_SCHEMAS_ENABLED */
-    }
 
-    return invalidFound;
+    return job.invalidFound;
 }
@@ -11,7 +11,11 @@ bigxml-relaxng
 bigxml-well-formed
 bigxml-xsd
 c14n-default-attr
+c14n-digest
+c14n-jobs
 c14n-newlines
+c14n-stream
+c14n-xpath
 c14n1
 c14n2
 command-help
@@ -20,6 +24,7 @@ countnode1
 delete1
 depyx-bug120a
 depyx-bug120b
+depyx-long-line
 dtd1
 dtd2
 dtd3
@@ -39,15 +44,24 @@ ed-subnode
 elem1
 elem2
 elem3
+elem-count
 elem-depth
+elem-files
 elem-uniq
 escape1
 exslt-ed
 exslt1
 external-entity
 findfile1
+fo-inplace
+fo-jobs
+fo-minify
+fo-stream
 genxml1
 hello1
+infer-dtd
+infer-rng
+infer-xsd
 localname1
 look1
 move1
@@ -55,7 +69,9 @@ N-order
 noindent1
 ns1
 pyx
+pyx-no-sort
 pyx-ns
+pyx-stdin
 recover1
 rename-attr1
 rename-elem1
@@ -82,11 +98,24 @@ unicode1
 update-attr1
 update-elem1
 valid1
+valid-dtd-content
+valid-dtd-ids
+valid-dtd-ns
+valid-files-from
+valid-jobs
+xinclude-cache
 xinclude1
+xsl-files-from
+xsl-jobs
+xsl-output-dir
 xsl-param1
+xsl-params-file
+xsl-profile
+xsl-stream-split
+xsl-stream-split-dir
 xsl-sum1'
 
-XFAIL_TESTS='bigxml-dtd|ed-namespace'
+XFAIL_TESTS='ed-namespace'
 
 
 testdir=`dirname $0`